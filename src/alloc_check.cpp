@@ -0,0 +1,108 @@
+#include "alloc_check.h"
+
+#ifdef UI_ALLOC_CHECK
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "sdl.h"
+
+namespace {
+	std::atomic<bool> g_armed{ false };
+	std::atomic<size_t> g_count{ 0 };
+
+	void count() {
+		if (g_armed.load(std::memory_order_relaxed)) {
+			g_count.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void* allocate(size_t size) {
+		count();
+		return std::malloc(size ? size : 1);
+	}
+
+	// MSVC has no aligned_alloc, and its aligned blocks must go back through _aligned_free
+	void* allocateAligned(size_t size, size_t align) {
+		count();
+		if (size == 0) size = 1;
+#ifdef _MSC_VER
+		return _aligned_malloc(size, align);
+#else
+		return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+	}
+
+	void releaseAligned(void* ptr) {
+#ifdef _MSC_VER
+		_aligned_free(ptr);
+#else
+		std::free(ptr);
+#endif
+	}
+}
+
+namespace AllocCheck {
+	// SDL allocates through its own hooks rather than operator new, so they're counted too
+	bool install() {
+		return SDL_SetMemoryFunctions(
+			[](size_t size) { count(); return std::malloc(size); },
+			[](size_t n, size_t size) { count(); return std::calloc(n, size); },
+			[](void* ptr, size_t size) { count(); return std::realloc(ptr, size); },
+			[](void* ptr) { std::free(ptr); }
+		) == 0;
+	}
+
+	void arm() {
+		g_count.store(0, std::memory_order_relaxed);
+		g_armed.store(true, std::memory_order_relaxed);
+	}
+
+	size_t disarm() {
+		g_armed.store(false, std::memory_order_relaxed);
+		return g_count.load(std::memory_order_relaxed);
+	}
+}
+
+void* operator new(size_t size) {
+	if (void* ptr = allocate(size)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	if (void* ptr = allocate(size)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+	if (void* ptr = allocateAligned(size, size_t(align))) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+	if (void* ptr = allocateAligned(size, size_t(align))) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { releaseAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { releaseAligned(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { releaseAligned(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { releaseAligned(ptr); }
+
+#else
+
+namespace AllocCheck {
+	bool install() { return true; }
+	void arm() {}
+	size_t disarm() { return 0; }
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+#include <cstddef>
+
+/**
+ * Counts heap allocations made through the global operator new or SDL's allocator while armed.
+ * Direct malloc calls (the C runtime, graphics drivers) aren't seen, so a clean count doesn't
+ * rule those out.
+ * Only active in builds configured with SYNTH_ALLOC_CHECK (defines UI_ALLOC_CHECK),
+ * otherwise install/arm/disarm are no-ops and the global allocator is left untouched.
+ */
+namespace AllocCheck {
+	/**
+	 * @brief  Routes SDL's allocations through the counter
+	 * @note   Call first thing in main, before SDL allocates anything
+	 * @retval false if SDL refused the hooks, in which case its allocations go uncounted
+	 */
+	bool install();
+
+	void arm();
+
+	/**
+	 * @brief  Stops counting
+	 * @retval Number of allocations made since arm()
+	 */
+	size_t disarm();
+}
+
+#endif // ALLOC_CHECK_H
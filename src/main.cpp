@@ -1,43 +1,165 @@
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 
 #include "sdl.h"
 #include "ui.h"
+#include "alloc_check.h"
 
 int main(int argc, const char** argv) {
+	if (!AllocCheck::install()) {
+		std::cerr << "Can't hook SDL's allocator: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+
 	SDL_Init(SDL_INIT_EVERYTHING);
 
 	SDL_Window* win = SDL_CreateWindow("Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_SHOWN);
-	SDL_Renderer* ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
 
-	std::unique_ptr<Device> dev = std::make_unique<Device>(win, ren);
-	dev->loadSkin("../gui.bmp");
+	// --pipeline <depth> renders on a separate thread, up to depth frames behind; that thread
+	// creates the renderer, so SDL's render API is never used from two threads
+	int pipelineDepth = 0;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--pipeline") pipelineDepth = std::atoi(argv[i + 1]);
+	}
+
+	SDL_Renderer* ren = nullptr;
+	std::unique_ptr<Device> dev;
+	if (pipelineDepth > 0) {
+		dev = Device::pipelined(win, SDL_RENDERER_ACCELERATED, pipelineDepth);
+	} else if ((ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED))) {
+		dev = std::make_unique<Device>(win, ren);
+	}
+	if (!dev) {
+		std::cerr << "Can't create a renderer: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+
+	// The skin and the UI load in the background while the window already shows frames
+	using LoadedUI = std::pair<std::unique_ptr<UISystem>, WID>;
+	Staged<LoadedUI> stagedUI;
+	auto load = [&]() {
+		dev->loadSkinAsync("../gui.bmp");
+		stagedUI.start([]() {
+			auto staging = std::make_unique<UISystem>();
+			WID root = staging->loadUI("../test.ui");
+			return LoadedUI(std::move(staging), root);
+		});
+	};
+	load();
 
-	std::unique_ptr<UISystem> sys = std::make_unique<UISystem>();
+	std::unique_ptr<UISystem> sys;
+	WID body = 0;
 
 	bool running = true;
 
-	WID body = sys->loadUI("../test.ui");
-	sys->get<Button>("btn")->onPressed = [&]() {
-		std::string msg = std::string("Hello, ") + sys->get<Input>("name")->text;
-		SDL_ShowSimpleMessageBox(0, "Pressed", msg.c_str(), win);
-	};
+	// --record <file> saves the session's input for tools/replay
+	const char* recordPath = nullptr;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--record") recordPath = argv[i + 1];
+	}
+
+	InputTrace trace;
+
+#ifdef UI_PROFILE
+	// --profile <file> writes a Chrome trace of the session on exit
+	const char* profilePath = nullptr;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--profile") profilePath = argv[i + 1];
+	}
+	UI_PROFILE_THREAD("ui");
+#endif
+
+	// --latency prints input-to-present latency percentiles on exit
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--latency") dev->dumpLatencyOnExit(true);
+	}
+
+	std::string skinError;
+
+	// Frames without input since the last event; the first ones may still warm up caches
+	int quietFrames = 0;
 
 	SDL_Event e;
 	while (running) {
-		while (SDL_PollEvent(&e)) {
-			if (e.type == SDL_QUIT) running = false;
-			sys->processEvents(*dev, e, body);
+		quietFrames++;
+
+		// Sleep until there is input or something to animate; the overlay graphs every frame
+		const bool reloading = stagedUI.pending() || dev->loadingSkin();
+		const bool loading = reloading || dev->loadingImages();
+		int timeout = dev->statsEnabled() ? 0 : loading ? 16 : sys ? sys->timeout() : -1;
+		if (SDL_WaitEventTimeout(&e, timeout)) {
+			do {
+				quietFrames = 0;
+				if (e.type == SDL_QUIT) running = false;
+				if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) dev->renderReset(e.type == SDL_RENDER_DEVICE_RESET);
+				if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3) dev->statsEnabled(!dev->statsEnabled());
+				if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F5 && !reloading) load();
+				if (sys) sys->processEvents(*dev, e, body);
+			} while (SDL_PollEvent(&e));
+		}
+
+#ifdef UI_ALLOC_CHECK
+		const bool steady = quietFrames > 2;
+		if (steady) AllocCheck::arm();
+#endif
+
+		// A finished UI replaces the current one between frames
+		if (auto loaded = stagedUI.take()) {
+			sys = std::move(loaded->first);
+			body = loaded->second;
+			// The new UI reuses widget ids and versions, so the old UI's lists would match
+			dev->clearDisplayLists();
+			if (recordPath) sys->record(&trace);
+			// The greeting shows below the input for a few seconds; a message box would block
+			// this thread, and with it every frame, until dismissed
+			sys->get<Button>("btn")->onPressed = [&]() -> Task {
+				UISystem* ui = sys.get();
+				WID message = ui->find("message");
+				std::string msg = std::string("Hello, ") + ui->get<Input>("name")->text;
+				ui->set(message, "text", msg);
+				co_await ui->sleep(3.0);
+				// A later press has replaced it in the meantime
+				if (ui->get<Text>("message")->text == msg) ui->set(message, "text", std::string());
+			};
 		}
 
-		sys->draw(*dev, body, Context());
+		if (sys && dev->skin()) sys->draw(*dev, body, Context());
+		dev->drawStats();
 
 		dev->flush();
+		dev->present();
+
+		// A failed reload keeps the previous skin; without one there's nothing to draw
+		if (dev->skinError() != skinError) {
+			skinError = dev->skinError();
+			if (!skinError.empty()) std::cerr << skinError << std::endl;
+			if (!skinError.empty() && !dev->skin()) running = false;
+		}
+
+#ifdef UI_ALLOC_CHECK
+		if (steady) {
+			if (size_t count = AllocCheck::disarm()) {
+				std::cerr << "Steady frame performed " << count << " heap allocation(s)" << std::endl;
+				std::abort();
+			}
+		}
+#endif
+	}
+
+	if (recordPath && !trace.save(recordPath)) {
+		std::cerr << "Can't write trace " << recordPath << std::endl;
+	}
 
-		SDL_RenderPresent(ren);
+#ifdef UI_PROFILE
+	if (profilePath && !Profiler::dump(profilePath)) {
+		std::cerr << "Can't write profile " << profilePath << std::endl;
 	}
+#endif
 
-	SDL_DestroyRenderer(ren);
+	// Frees textures while the renderer still exists; a pipelined Device destroys its own
+	dev.reset();
+	if (ren) SDL_DestroyRenderer(ren);
 	SDL_DestroyWindow(win);
 	SDL_Quit();
 	return 0;
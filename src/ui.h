@@ -4,18 +4,39 @@
 #include "sdl.h"
 
 #include <cstdint>
+#include <climits>
 #include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <variant>
 #include <functional>
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <stack>
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <regex>
 #include <fstream>
 #include <streambuf>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <tuple>
+#include <future>
+#include <thread>
+#include <coroutine>
+#include <deque>
+#include <condition_variable>
 
 struct Rect {
 	int x{ 0 }, y{ 0 }, width{ 0 }, height{ 0 };
@@ -38,379 +59,2606 @@ struct Rect {
 		return width * height > 0;
 	}
 
+	Rect intersect(const Rect& o) const {
+		int l = std::max(x, o.x), t = std::max(y, o.y);
+		int r = std::min(x + width, o.x + o.width), b = std::min(y + height, o.y + o.height);
+		return Rect(l, t, std::max(r - l, 0), std::max(b - t, 0));
+	}
+
+	bool overlaps(const Rect& o) const {
+		return x < o.x + o.width && o.x < x + width &&
+				y < o.y + o.height && o.y < y + height;
+	}
+
 	Rect() = default;
-	Rect(const Rect& o) : x(o.x), y(o.y), width(o.width), height(o.height) {}
+	Rect(const Rect&) = default;
+	Rect& operator=(const Rect&) = default;
 	Rect(int x, int y, int width, int height) : x(x), y(y), width(width), height(height) {}
+
+	bool operator==(const Rect&) const = default;
 };
 
 struct Color {
 	uint8_t r, g, b;
+
+	bool operator==(const Color&) const = default;
 };
 
-class Device {
-public:
-	Device(SDL_Window* window, SDL_Renderer* renderer) : m_window(window), m_renderer(renderer) {
-		SDL_StartTextInput();
+/**
+ * @brief  Decodes the UTF-8 code point starting at str[i] and advances i past it
+ * @note   Malformed sequences decode to U+FFFD, one byte at a time
+ * @retval The code point
+ */
+inline uint32_t utf8Next(std::string_view str, size_t& i) {
+	constexpr uint32_t Invalid = 0xFFFD;
+	const uint8_t c = uint8_t(str[i++]);
+	if (c < 0x80) return c;
+
+	int length;
+	uint32_t cp, min;
+	if ((c & 0xE0) == 0xC0) { length = 1; cp = c & 0x1F; min = 0x80; }
+	else if ((c & 0xF0) == 0xE0) { length = 2; cp = c & 0x0F; min = 0x800; }
+	else if ((c & 0xF8) == 0xF0) { length = 3; cp = c & 0x07; min = 0x10000; }
+	else return Invalid;
+
+	if (i + length > str.size()) return Invalid;
+	for (int k = 0; k < length; k++) {
+		const uint8_t cc = uint8_t(str[i + k]);
+		if ((cc & 0xC0) != 0x80) return Invalid;
+		cp = (cp << 6) | (cc & 0x3F);
 	}
+	if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return Invalid;
 
-	~Device() {
-		SDL_DestroyTexture(m_theme);
-	}
+	i += length;
+	return cp;
+}
+
+/**
+ * Wait-free single-producer, single-consumer ring buffer.
+ * The capacity is rounded up to a power of two and allocated once, by the consumer.
+ */
+template<typename T>
+class SpscRing {
+	static_assert(std::is_trivially_copyable_v<T>, "SpscRing elements are copied between threads");
+
+public:
+	explicit SpscRing(size_t capacity)
+		: m_mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+		  m_buffer(std::make_unique<T[]>(m_mask + 1)) {}
 
 	/**
-	 * @brief  Loads a skin texture
-	 * @note   Must be in BMP format
-	 * @param  path: Image path
-	 * @retval None
+	 * @brief  Producer side: appends an element, never blocking or allocating
+	 * @retval false if the ring is full (the element is dropped)
 	 */
-	void loadSkin(const std::string& path) {
-		if (m_theme) {
-			SDL_DestroyTexture(m_theme);
+	bool push(const T& value) {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_headCache > m_mask) {
+			m_headCache = m_head.load(std::memory_order_acquire);
+			if (tail - m_headCache > m_mask) return false;
 		}
-		m_charOffsets.clear();
-		m_charAdvances.clear();
-
-		SDL_Surface* surf = SDL_LoadBMP(path.c_str());
-		surf = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGB24, 0);
-
-		// Read char offsets (blue dots)
-		SDL_LockSurface(surf);
-		uint8_t* pixels = (uint8_t*)surf->pixels;
+		m_buffer[tail & m_mask] = value;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
 
-		const int cellW = surf->w / 16;
-		const int cellH = surf->h / 16;
-		for (int ty = 0; ty < 16; ty++) {
-			for (int tx = 0; tx < 16; tx++) {
-				int tpx = tx * cellW,
-					tpy = ty * cellH;
-				
-				int fx = 0, fy = 0, ax = cellW;
-				for (int oy = 0; oy < cellH; oy++) {
-					for (int ox = 0; ox < cellW; ox++) {
-						int i = ((ox + tpx) + (oy + tpy) * surf->w) * 3;
-						if (pixels[i + 2] == 255 && pixels[i + 1] == 0 && pixels[i] == 0) {
-							pixels[i + 0] = 255;
-							fx = ox; fy = cellH - 1 - oy;
-						} else if (pixels[i + 2] == 0 && pixels[i + 1] == 255 && pixels[i] == 0) {
-							pixels[i + 0] = 255;
-							pixels[i + 1] = 0;
-							pixels[i + 2] = 255;
-							ax = ox;
-						}
-					}
-				}
-				m_charOffsets[tx + ty * 16] = std::make_pair(fx, fy);
-				m_charAdvances[tx + ty * 16] = ax;
-			}
+	/**
+	 * @brief  Consumer side: takes the oldest element
+	 * @retval false if the ring is empty
+	 */
+	bool pop(T& out) {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tailCache) {
+			m_tailCache = m_tail.load(std::memory_order_acquire);
+			if (head == m_tailCache) return false;
 		}
-
-		SDL_UnlockSurface(surf);
-
-		SDL_SetColorKey(surf, 1, SDL_MapRGB(surf->format, 255, 0, 255));
-		m_theme = SDL_CreateTextureFromSurface(m_renderer, surf);
-		SDL_FreeSurface(surf);
-		SDL_QueryTexture(m_theme, nullptr, nullptr, &m_themeWidth, &m_themeHeight);
+		out = m_buffer[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
 	}
 
-	int textWidth(const std::string& str) {
-		int acc = 0;
-		for (char c : str) {
-			auto off = m_charOffsets[int(c)];
-			acc += (m_charAdvances[int(c)] - std::get<0>(off));
-		}
-		return acc;
+	/**
+	 * @brief  Producer side: appends as many elements as fit
+	 * @retval Number of elements written
+	 */
+	size_t push(const T* values, size_t count) {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_headCache + count > m_mask + 1) m_headCache = m_head.load(std::memory_order_acquire);
+		count = std::min(count, m_mask + 1 - (tail - m_headCache));
+		for (size_t i = 0; i < count; i++) m_buffer[(tail + i) & m_mask] = values[i];
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
 	}
 
-	void debugRect(int x, int y, int w, int h) {
-		m_commands.push_back(Command{
-			.type = Command::CmdDebug,
-			.glyph = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-			.clip = { x, y, w, h },
-			.order = m_currentOrder++
-		});
+	/**
+	 * @brief  Consumer side: takes up to `count` of the oldest elements
+	 * @retval Number of elements read
+	 */
+	size_t pop(T* out, size_t count) {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (m_tailCache - head < count) m_tailCache = m_tail.load(std::memory_order_acquire);
+		count = std::min(count, m_tailCache - head);
+		for (size_t i = 0; i < count; i++) out[i] = m_buffer[(head + i) & m_mask];
+		m_head.store(head + count, std::memory_order_release);
+		return count;
 	}
 
-	int drawChar(char c, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
-		const int cellW = m_themeWidth / 16;
-		const int cellH = m_themeHeight / 16;
+	size_t capacity() const { return m_mask + 1; }
 
-		c &= 0xFF;
+	// Approximate when called while the other side is running
+	size_t size() const {
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
 
-		int sx = (int(c) % 16) * cellW;
-		int sy = (int(c) / 16) * cellH;
+private:
+	static constexpr size_t CacheLine = 64;
 
-		auto off = m_charOffsets[int(c)];
+	const size_t m_mask;
+	std::unique_ptr<T[]> m_buffer;
 
-		int cx = x - std::get<0>(off);
-		int cy = y + std::get<1>(off);
+	// Each side owns one index and caches the other's, on separate cache lines
+	alignas(CacheLine) std::atomic<size_t> m_tail{ 0 };
+	size_t m_headCache{ 0 };
+	alignas(CacheLine) std::atomic<size_t> m_head{ 0 };
+	size_t m_tailCache{ 0 };
+};
 
-		m_commands.push_back(Command{
-			.type = Command::CmdDraw,
-			.glyph = { cx, cy, cellW, cellH, sx, sy, cellW, cellH, r, g, b },
-			.clip = { 0, 0, 0, 0 },
-			.order = m_currentOrder++
-		});
+/**
+ * Wakes the UI thread's event loop from another thread. Only the first notify() after
+ * the UI re-armed the signal posts an event, so a busy producer takes SDL's event queue
+ * lock at most once per frame.
+ */
+class WakeSignal {
+public:
+	// Registers the event type up front, so producers never do
+	WakeSignal() { eventType(); }
 
-		return m_charAdvances[int(c)] - std::get<0>(off)/*  + m_charSpacingX */;
+	/**
+	 * @brief  Producer side: call after publishing the data the UI should pick up
+	 */
+	void notify() {
+		if (m_pending.exchange(true, std::memory_order_acq_rel)) return;
+		SDL_Event e{};
+		e.type = eventType();
+		SDL_PushEvent(&e);
 	}
 
-	void drawTileSection(int index, int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, int rx, int ry, int rw, int rh) {
-		const int cellW = m_themeWidth / 16;
-		const int cellH = m_themeHeight / 16;
+	/**
+	 * @brief  UI side: call before reading the data, so anything published later wakes the loop again
+	 */
+	void rearm() { m_pending.exchange(false, std::memory_order_acq_rel); }
 
-		index &= 0xFF;
+	/**
+	 * @brief  Type of the events posted; UISystem ignores them, they only end the wait
+	 */
+	static Uint32 eventType() {
+		static const Uint32 type = [](){
+			Uint32 t = SDL_RegisterEvents(1);
+			return t == Uint32(-1) ? Uint32(SDL_USEREVENT) : t;
+		}();
+		return type;
+	}
 
-		rx = rx > cellW ? cellW : rx;
-		rx = rx < 0 ? cellW+rx : rx;
-		ry = ry > cellH ? cellH : ry;
-		ry = ry < 0 ? cellH+ry : ry;
-		rw = rw < 0 ? cellW+rw : rw;
-		rh = rh < 0 ? cellH+rh : rh;
-		rw = std::clamp(rw, 0, cellW);
-		rh = std::clamp(rh, 0, cellH);
+private:
+	std::atomic<bool> m_pending{ false };
+};
 
-		int sx = (int(index) % 16) * cellW;
-		int sy = (int(index) / 16) * cellH;
+/**
+ * Audio samples from the audio callback to a Meter or Scope widget; one widget reads each ring.
+ * Pushing wakes the UI once the widget has drained what came before, so nothing is polled.
+ */
+class SampleRing : public SpscRing<float> {
+public:
+	using SpscRing::SpscRing;
 
-		m_commands.push_back(Command{
-			.type = Command::CmdDraw,
-			.glyph = { x, y, w, h, sx + rx, sy + ry, rw, rh, r, g, b },
-			.clip = { 0, 0, 0, 0 },
-			.order = m_currentOrder++
-		});
+	bool push(float value) {
+		if (!SpscRing::push(value)) return false;
+		m_signal.notify();
+		return true;
 	}
 
-	void drawText(const std::string& str, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
-		int tx = 0, ty = 0;
-		for (char c : str) {
-			if (c == '\n') {
-				tx = 0;
-				ty += (m_themeHeight / 16) + m_charSpacingY;
-			} else if (isspace(c) && c != '\n') {
-				tx += m_charAdvances[int(c)] - std::get<0>(m_charOffsets[int(c)]);
-			} else {
-				tx += drawChar(c, tx + x, ty + y, r, g, b);
-			}
-		}
+	size_t push(const float* values, size_t count) {
+		count = SpscRing::push(values, count);
+		if (count) m_signal.notify();
+		return count;
 	}
 
-	void drawPatch(int index, int x, int y, int w, int h, uint8_t r = 0xFF, uint8_t g = 0xFF, uint8_t b = 0xFF) {
-		const int p = m_patchPadding;
-
-		// corners
-		drawTileSection(index,  x, y, p, p,                  r, g, b,   0,  0, p, p);
-		drawTileSection(index,  x + w - p, y, p, p,          r, g, b,  -p,  0, p, p);
-		drawTileSection(index,  x, y + h - p, p, p,          r, g, b,   0, -p, p, p);
-		drawTileSection(index,  x + w - p, y + h - p, p, p,  r, g, b,  -p, -p, p, p);
+	/**
+	 * @brief  Consumer side: call before popping, so later pushes wake the UI again
+	 */
+	void rearm() { m_signal.rearm(); }
 
-		// beams
-		drawTileSection(index,  x + p, y, w - p*2, p,           r, g, b,    p,  0, -p*2, p);
-		drawTileSection(index,  x + p, y + h - p, w - p*2, p,   r, g, b,    p, -p, -p*2, p);
-		drawTileSection(index,  x, y + p, p, h - p*2,           r, g, b,    0,  p,  p,  -p*2);
-		drawTileSection(index,  x + w - p, y + p, p, h - p*2,   r, g, b,   -p,  p,  p,  -p*2);
+private:
+	WakeSignal m_signal;
+};
 
-		//middle
-		drawTileSection(index,  x + p, y + p, w - p*2, h - p*2,  r, g, b,  p, p, -p*2, -p*2);
+/**
+ * HDR-style histogram of durations in microseconds.
+ * Buckets are log-linear with 32 sub-buckets per power of two, so any recorded
+ * value is reported within ~3% and nothing is allocated.
+ */
+class LatencyHistogram {
+public:
+	void record(uint64_t us) {
+		m_buckets[bucket(us)]++;
+		m_count++;
+		m_sum += us;
+		m_max = std::max(m_max, us);
 	}
 
-	void drawBalloon(int x, int y, int width, int height) {
-		drawPatch(8, x - width / 2, y + 4, width, height);
-		drawPatch(9, x - cellWidth() / 2, y - (cellHeight() - 4), cellWidth(), cellHeight());
-	}
+	uint64_t count() const { return m_count; }
+	uint64_t max() const { return m_max; }
+	double mean() const { return m_count ? double(m_sum) / double(m_count) : 0.0; }
 
-	void clip(int x, int y, int w, int h) {
-		m_commands.push_back(Command{
-			.type = Command::CmdClip,
-			.glyph = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-			.clip = { x, y, w, h },
-			.order = m_currentOrder++
-		});
+	/**
+	 * @brief  Value at a percentile
+	 * @param  p: Percentile, 0 to 100
+	 * @retval Upper bound of the bucket holding it, in microseconds
+	 */
+	uint64_t percentile(double p) const {
+		if (!m_count) return 0;
+		uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(p / 100.0 * double(m_count))));
+		uint64_t seen = 0;
+		for (int i = 0; i < Buckets; i++) {
+			seen += m_buckets[i];
+			if (seen >= rank) return std::min(upperBound(i), m_max);
+		}
+		return m_max;
 	}
 
-	void unclip() {
-		m_commands.push_back(Command{
-			.type = Command::CmdUnClip,
-			.glyph = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-			.clip = { 0, 0, 0, 0 },
-			.order = m_currentOrder++
-		});
+	void reset() { *this = LatencyHistogram{}; }
+
+	void print(FILE* out, const char* name) const {
+		std::fprintf(out, "%s: %llu samples, mean %.2f ms, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+			name, (unsigned long long)m_count, mean() / 1000.0,
+			percentile(50) / 1000.0, percentile(90) / 1000.0, percentile(99) / 1000.0, m_max / 1000.0);
 	}
 
-	void flush() {
-		SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
-		SDL_RenderClear(m_renderer);
+private:
+	static constexpr int SubBits = 5, SubBuckets = 1 << SubBits;
+	static constexpr int Buckets = 36 * SubBuckets; // up to 2^40 us
 
-		std::sort(m_commands.begin(), m_commands.end(), [&](const Command& a, const Command& b){ return a.order < b.order; });
-
-		for (auto& cmd : m_commands) {
-			switch (cmd.type) {
-				case Command::CmdDraw: {
-					SDL_Rect src = { cmd.glyph.rx, cmd.glyph.ry, cmd.glyph.rw, cmd.glyph.rh };
-					SDL_Rect dst = { cmd.glyph.x, cmd.glyph.y, cmd.glyph.w, cmd.glyph.h };
-					SDL_SetTextureColorMod(m_theme, cmd.glyph.r, cmd.glyph.g, cmd.glyph.b);
-					SDL_RenderCopy(m_renderer, m_theme, &src, &dst);
-				} break;
-				case Command::CmdClip: {
-					clipPush(cmd.clip.x, cmd.clip.y, cmd.clip.w, cmd.clip.h);
-				} break;
-				case Command::CmdUnClip: {
-					clipPop();
-				} break;
-				case Command::CmdDebug: {
-					SDL_Rect r = { cmd.clip.x, cmd.clip.y, cmd.clip.w, cmd.clip.h };
-					SDL_SetRenderDrawColor(m_renderer, 0, 255, 100, 255);
-					SDL_RenderDrawRect(m_renderer, &r);
-				} break;
-			}
-		}
+	uint32_t m_buckets[Buckets]{};
+	uint64_t m_count{ 0 }, m_sum{ 0 }, m_max{ 0 };
 
-		m_commands.clear();
-		while (!m_orderStack.empty()) m_orderStack.pop();
-		m_currentOrder = 0;
+	static int bucket(uint64_t v) {
+		if (v < SubBuckets * 2) return int(v);
+		int shift = int(std::bit_width(v)) - (SubBits + 1);
+		return std::min(Buckets - 1, (shift + 1) * SubBuckets + int((v >> shift) - SubBuckets));
 	}
 
-	void pushOrder(int base) {
-		m_orderStack.push(m_currentOrder);
-		m_currentOrder = base;
+	static uint64_t upperBound(int index) {
+		if (index < SubBuckets * 2) return uint64_t(index);
+		int shift = index / SubBuckets - 1;
+		return ((uint64_t(index % SubBuckets + SubBuckets) + 1) << shift) - 1;
 	}
+};
 
-	void popOrder() {
-		if (m_orderStack.empty()) return;
-		m_currentOrder = m_orderStack.top();
-		m_orderStack.pop();
-	}
+#ifdef UI_PROFILE
 
-	int charSpacingX() const { return m_charSpacingX; }
-	void charSpacingX(int charSpacingX) { m_charSpacingX = charSpacingX; }
+/**
+ * Scoped timing events kept in per-thread rings and exported in Chrome trace JSON
+ * (chrome://tracing, Perfetto). Only built with UI_PROFILE (CMake option SYNTH_PROFILE);
+ * otherwise the UI_PROFILE_* macros expand to nothing.
+ */
+class Profiler {
+public:
+	// Per thread; the oldest events are overwritten
+	static constexpr size_t BufferEvents = 1 << 16;
 
-	int charSpacingY() const { return m_charSpacingY; }
-	void charSpacingY(int charSpacingY) { m_charSpacingY = charSpacingY; }
+	struct Event {
+		const char* name;
+		uint64_t begin, end; // performance counter
+		int64_t id;          // widget, or -1
+	};
 
-	int patchPadding() const { return m_patchPadding; }
-	void patchPadding(int patchPadding) { m_patchPadding = patchPadding; }
+	/**
+	 * @brief  Appends a finished event to the calling thread's ring
+	 * @note   Lock-free after the thread's first event, which registers its ring. Events
+	 *         finishing while dump() or clear() run are dropped.
+	 * @param  name: Static string
+	 * @retval None
+	 */
+	static void record(const char* name, uint64_t begin, uint64_t end, int64_t id = -1) {
+		Buffer& buf = buffer();
+		// Pairs with pause(): either it sees this write in progress, or this sees it paused
+		buf.writing.store(true);
+		if (registry().enabled.load()) {
+			uint64_t head = buf.head.load(std::memory_order_relaxed);
+			buf.events[head & (BufferEvents - 1)] = Event{ name, begin, end, id };
+			buf.head.store(head + 1, std::memory_order_release);
+		}
+		buf.writing.store(false);
+	}
 
-	const int& themeWidth() const { return m_themeWidth; }
-	const int& themeHeight() const { return m_themeHeight; }
+	// Names the calling thread in exported traces
+	static void threadName(const char* name) {
+		buffer().name = name;
+	}
 
-	int cellWidth() const { return m_themeWidth / 16; }
-	int cellHeight() const { return m_themeHeight / 16; }
+	/**
+	 * @brief  Writes every thread's events as Chrome trace JSON
+	 * @note   Recording is paused while the events are written
+	 * @param  path: Output file
+	 * @retval false if the file can't be written
+	 */
+	static bool dump(const std::string& path) {
+		FILE* fp = std::fopen(path.c_str(), "w");
+		if (!fp) return false;
+
+		const double usPerTick = 1e6 / double(SDL_GetPerformanceFrequency());
+		const uint64_t origin = registry().origin;
+
+		std::lock_guard lock(registry().mutex);
+		Pause pause(registry());
+		std::fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool first = true;
+		for (auto& buf : registry().buffers) {
+			if (buf->name) {
+				std::fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buf->tid, buf->name);
+				first = false;
+			}
 
-	std::pair<int, int> size() const {
-		int w, h;
-		SDL_GetWindowSize(m_window, &w, &h);
-		return std::make_pair(w, h);
+			uint64_t head = buf->head.load(std::memory_order_acquire);
+			for (uint64_t i = head > BufferEvents ? head - BufferEvents : 0; i < head; i++) {
+				const Event& e = buf->events[i & (BufferEvents - 1)];
+				std::fprintf(
+					fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+					first ? "" : ",\n", e.name, buf->tid,
+					double(e.begin - std::min(e.begin, origin)) * usPerTick, double(e.end - e.begin) * usPerTick
+				);
+				if (e.id >= 0) std::fprintf(fp, ",\"args\":{\"id\":%lld}", (long long)e.id);
+				std::fprintf(fp, "}");
+				first = false;
+			}
+		}
+		std::fprintf(fp, "\n]}\n");
+		return std::fclose(fp) == 0;
+	}
+
+	// Drops recorded events; threads keep their rings
+	static void clear() {
+		std::lock_guard lock(registry().mutex);
+		Pause pause(registry());
+		for (auto& buf : registry().buffers) buf->head.store(0, std::memory_order_release);
 	}
 
 private:
-	struct Command {
-		enum {
-			CmdDraw = 0,
-			CmdClip,
-			CmdUnClip,
-			CmdDebug
-		} type;
-
-		struct {
-			int x, y, w, h, rx, ry, rw, rh;
-			uint8_t r, g, b;
-		} glyph;
-
-		struct {
-			int x, y, w, h;
-		} clip;
+	struct Buffer {
+		std::unique_ptr<Event[]> events{ new Event[BufferEvents] };
+		std::atomic<uint64_t> head{ 0 };
+		std::atomic<bool> writing{ false };
+		uint32_t tid{ 0 };
+		const char* name{ nullptr };
+	};
 
-		int order{ 0 };
+	// Rings outlive their threads so events of finished loaders are still exported
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<Buffer>> buffers;
+		std::atomic<bool> enabled{ true };
+		uint64_t origin{ SDL_GetPerformanceCounter() };
 	};
 
-	std::vector<Command> m_commands;
-	std::stack<int> m_orderStack;
-	std::stack<Rect> m_clips;
-	std::map<uint8_t, std::pair<int, int>> m_charOffsets;
-	std::map<uint8_t, int> m_charAdvances;
-	int m_currentOrder{ 0 };
+	// Stops recording and waits out events being written, so the rings can be read or reset.
+	// Taken with the registry mutex held, which keeps new rings from registering.
+	struct Pause {
+		Registry& reg;
 
-	SDL_Renderer* m_renderer;
-	SDL_Window* m_window;
+		explicit Pause(Registry& r) : reg(r) {
+			reg.enabled.store(false);
+			for (auto& buf : reg.buffers) {
+				while (buf->writing.load()) std::this_thread::yield();
+			}
+		}
+		~Pause() { reg.enabled.store(true); }
+	};
 
-	SDL_Texture* m_theme{ nullptr };
-	int m_themeWidth, m_themeHeight;
+	static Registry& registry() {
+		static Registry reg;
+		return reg;
+	}
 
-	int m_charSpacingX{ -4 }, m_charSpacingY{ -2 }, m_patchPadding{ 5 };
-	
-	void clipPush(int x, int y, int w, int h) {
-		SDL_Rect rec = { x, y, w, h };
-		SDL_RenderSetClipRect(m_renderer, &rec);
-		m_clips.push(Rect(x, y, w, h));
+	static Buffer& buffer() {
+		thread_local Buffer* buf = [] {
+			Registry& reg = registry();
+			std::lock_guard lock(reg.mutex);
+			reg.buffers.push_back(std::make_unique<Buffer>());
+			reg.buffers.back()->tid = uint32_t(reg.buffers.size());
+			return reg.buffers.back().get();
+		}();
+		return *buf;
 	}
+};
 
-	void clipPop() {
-		if (!m_clips.empty()) m_clips.pop();
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* name, int64_t id = -1)
+		: m_name(name), m_id(id), m_begin(SDL_GetPerformanceCounter()) {}
 
-		if (!m_clips.empty()) {
-			Rect b = m_clips.top();
-			SDL_Rect rec = { b.x, b.y, b.width, b.height };
-			SDL_RenderSetClipRect(m_renderer, &rec);
-		} else {
-			SDL_RenderSetClipRect(m_renderer, nullptr);
-		}
+	~ProfileScope() {
+		Profiler::record(m_name, m_begin, SDL_GetPerformanceCounter(), m_id);
 	}
 
-};
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
 
-enum Alignment {
-	Near = 0,
-	Center,
-	Far
+private:
+	const char* m_name;
+	int64_t m_id;
+	uint64_t m_begin;
 };
 
-struct MouseEvent {
-	enum {
-		MouseEventDown,
-		MouseEventUp,
-		MouseEventMove
-	} type{ MouseEventMove };
-	int x{ 0 }, y{ 0 }, button{ 0 };
-};
+#define UI_PROFILE_CONCAT_(a, b) a##b
+#define UI_PROFILE_CONCAT(a, b) UI_PROFILE_CONCAT_(a, b)
+#define UI_PROFILE_SCOPE(name) ProfileScope UI_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define UI_PROFILE_SCOPE_ID(name, id) ProfileScope UI_PROFILE_CONCAT(profileScope, __LINE__)(name, int64_t(id))
+#define UI_PROFILE_THREAD(name) Profiler::threadName(name)
+
+#else
+
+#define UI_PROFILE_SCOPE(name) ((void)0)
+#define UI_PROFILE_SCOPE_ID(name, id) ((void)0)
+#define UI_PROFILE_THREAD(name) ((void)0)
+
+#endif
+
+struct FrameStats {
+	enum Phase {
+		PhaseEvents = 0,
+		PhaseLayout,
+		PhaseRecord,
+		PhaseSort,
+		PhaseFlush,
+		PhasePresent,
+		PhaseCount
+	};
 
-struct KeyboardEvent {
-	enum {
-		KeyEventDown,
-		KeyEventType,
-		KeyEventCommand
-	} type{ KeyEventDown };
-	uint32_t key{ 0 };
-	char input{ 0 };
-};
+	static constexpr int CommandTypes = 5;
+	static constexpr int HistorySize = 64;
+
+	double phases[PhaseCount]{}; // milliseconds
+	int commands[CommandTypes]{};
+	int drawCalls{ 0 };
+	int widgetsVisited{ 0 };
+	int commandBytes{ 0 };
+	int patchCacheHits{ 0 }, patchCacheMisses{ 0 };
+	int culled{ 0 };
+	int listHits{ 0 }, listMisses{ 0 };
+
+	void reset() {
+		std::fill(std::begin(phases), std::end(phases), 0.0);
+		std::fill(std::begin(commands), std::end(commands), 0);
+		drawCalls = 0;
+		widgetsVisited = 0;
+		commandBytes = 0;
+		patchCacheHits = 0;
+		patchCacheMisses = 0;
+		culled = 0;
+		listHits = 0;
+		listMisses = 0;
+	}
 
-struct Context {
-	Rect bounds{};
+	void merge(const FrameStats& o) {
+		for (int i = 0; i < PhaseCount; i++) phases[i] += o.phases[i];
+		for (int i = 0; i < CommandTypes; i++) commands[i] += o.commands[i];
+		drawCalls += o.drawCalls;
+		widgetsVisited += o.widgetsVisited;
+		commandBytes += o.commandBytes;
+		patchCacheHits += o.patchCacheHits;
+		patchCacheMisses += o.patchCacheMisses;
+		culled += o.culled;
+		listHits += o.listHits;
+		listMisses += o.listMisses;
+	}
 };
 
-using WID = uint32_t;
+/**
+ * Parsed skin: atlas pixels and glyph metrics, shared by every Device using it.
+ * Renderer textures are created from it by each Device.
+ */
+class Skin {
+public:
+	// One 16x16 grid of glyphs, covering 256 code points.
+	// Page 0 is the skin itself, other pages are loaded on first use.
+	struct GlyphPage {
+		SDL_Surface* surface{ nullptr };
+		int cellWidth{ 0 }, cellHeight{ 0 };
+		int16_t offsetX[256]{}, offsetY[256]{}, advance[256]{};
+	};
 
-struct Text {
-	std::string text{};
-	Alignment align{ Alignment::Near };
-	Color color{ .r = 255, .g = 255, .b = 255 };
-};
+	~Skin() {
+		SDL_FreeSurface(m_base.surface);
+		for (auto& [index, page] : m_pages) {
+			if (page) SDL_FreeSurface(page->surface);
+		}
+	}
 
-enum ButtonState {
-	ButtonStateNormal = 0,
-	ButtonStateHover,
-	ButtonStatePressed
-};
+	Skin(const Skin&) = delete;
+	Skin& operator=(const Skin&) = delete;
 
-struct Button {
-	std::string text{};
-	std::function<void()> onPressed;
-	bool disabled{ false };
+	/**
+	 * @brief  Loads a skin, or returns the instance already loaded from the same path
+	 * @note   Must be in BMP format
+	 * @param  path: Image path
+	 * @param  reload: Reads the file again even if it's loaded; later loads share the new instance
+	 * @retval The skin, or nullptr if it can't be read
+	 */
+	static std::shared_ptr<const Skin> load(const std::string& path, bool reload = false) {
+		UI_PROFILE_SCOPE("Skin::load");
+		static std::mutex mutex;
+		static std::map<std::string, std::weak_ptr<const Skin>> loaded;
+
+		std::lock_guard lock(mutex);
+		if (!reload) {
+			if (auto skin = loaded[path].lock()) return skin;
+		}
 
-	ButtonState state{ ButtonStateNormal };
-};
+		SDL_Surface* surf = readGlyphSurface(path);
+		if (!surf) return nullptr;
 
-struct Root {
-	WID child;
-};
+		std::shared_ptr<Skin> skin(new Skin());
+		skin->m_path = path;
+		readGlyphMetrics(surf, skin->m_base);
+		loaded[path] = skin;
+		return skin;
+	}
+
+	const std::string& path() const { return m_path; }
+	const GlyphPage& base() const { return m_base; }
+
+	/**
+	 * @brief  Finds a glyph page, loading it on first use
+	 * @note   Page N is read from "<skin>.NNNN.bmp" (hex), next to the skin
+	 * @retval The page, or nullptr if it doesn't exist
+	 */
+	const GlyphPage* page(uint32_t index) const {
+		if (index == 0) return &m_base;
+
+		std::lock_guard lock(m_pagesMutex);
+		auto it = m_pages.find(index);
+		if (it == m_pages.end()) {
+			std::unique_ptr<GlyphPage> page;
+
+			char suffix[16];
+			std::snprintf(suffix, sizeof(suffix), ".%04X.bmp", index);
+			if (SDL_Surface* surf = readGlyphSurface(m_path.substr(0, m_path.rfind('.')) + suffix)) {
+				page = std::make_unique<GlyphPage>();
+				readGlyphMetrics(surf, *page);
+			}
+			it = m_pages.emplace(index, std::move(page)).first;
+		}
+		return it->second.get();
+	}
+
+private:
+	Skin() = default;
+
+	std::string m_path;
+	GlyphPage m_base;
+
+	// Pages never change once loaded; null when a page has no file
+	mutable std::mutex m_pagesMutex;
+	mutable std::unordered_map<uint32_t, std::unique_ptr<GlyphPage>> m_pages;
+
+	static SDL_Surface* readGlyphSurface(const std::string& path) {
+		SDL_Surface* bmp = SDL_LoadBMP(path.c_str());
+		if (!bmp) return nullptr;
+		SDL_Surface* surf = SDL_ConvertSurfaceFormat(bmp, SDL_PIXELFORMAT_RGB24, 0);
+		SDL_FreeSurface(bmp);
+		return surf;
+	}
+
+	/**
+	 * @brief  Reads glyph metrics from a 16x16 grid
+	 * @note   Blue dots mark glyph offsets, green dots the advance; both are keyed out
+	 * @param  surf: RGB24 surface, owned by the page afterwards
+	 * @param  page: Receives the metrics
+	 * @retval None
+	 */
+	static void readGlyphMetrics(SDL_Surface* surf, GlyphPage& page) {
+		SDL_LockSurface(surf);
+		uint8_t* pixels = (uint8_t*)surf->pixels;
+
+		const int cellW = surf->w / 16;
+		const int cellH = surf->h / 16;
+		for (int ty = 0; ty < 16; ty++) {
+			for (int tx = 0; tx < 16; tx++) {
+				int tpx = tx * cellW,
+					tpy = ty * cellH;
+				
+				int fx = 0, fy = 0, ax = cellW;
+				for (int oy = 0; oy < cellH; oy++) {
+					for (int ox = 0; ox < cellW; ox++) {
+						int i = (ox + tpx) * 3 + (oy + tpy) * surf->pitch;
+						if (pixels[i + 2] == 255 && pixels[i + 1] == 0 && pixels[i] == 0) {
+							pixels[i + 0] = 255;
+							fx = ox; fy = cellH - 1 - oy;
+						} else if (pixels[i + 2] == 0 && pixels[i + 1] == 255 && pixels[i] == 0) {
+							pixels[i + 0] = 255;
+							pixels[i + 1] = 0;
+							pixels[i + 2] = 255;
+							ax = ox;
+						}
+					}
+				}
+				page.offsetX[tx + ty * 16] = int16_t(fx);
+				page.offsetY[tx + ty * 16] = int16_t(fy);
+				page.advance[tx + ty * 16] = int16_t(ax);
+			}
+		}
+
+		SDL_UnlockSurface(surf);
+
+		SDL_SetColorKey(surf, 1, SDL_MapRGB(surf->format, 255, 0, 255));
+		page.surface = surf;
+		page.cellWidth = cellW;
+		page.cellHeight = cellH;
+	}
+};
+
+/**
+ * A value produced on a background thread, picked up by the UI thread at a frame boundary.
+ * Used to load skins and .ui files without stalling frames.
+ */
+template<typename T>
+class Staged {
+public:
+	Staged() = default;
+	Staged(const Staged&) = delete;
+	Staged& operator=(const Staged&) = delete;
+
+	~Staged() {
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	/**
+	 * @brief  Runs fn on a new thread
+	 * @note   Waits for a previous run that is still in progress
+	 * @param  fn: Callable returning T
+	 * @retval None
+	 */
+	template<typename Fn>
+	void start(Fn&& fn) {
+		if (m_thread.joinable()) m_thread.join();
+		std::packaged_task<T()> task(std::forward<Fn>(fn));
+		m_future = task.get_future();
+		m_thread = std::thread([task = std::move(task)]() mutable {
+			UI_PROFILE_THREAD("loader");
+			task();
+		});
+	}
+
+	bool pending() const { return m_future.valid(); }
+
+	/**
+	 * @brief  Takes the result if it's ready, without blocking
+	 * @retval The value, or nullopt if nothing finished since the last call
+	 */
+	std::optional<T> take() {
+		if (!m_future.valid() || m_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return std::nullopt;
+		}
+		m_thread.join();
+		return m_future.get();
+	}
+
+private:
+	std::thread m_thread;
+	std::future<T> m_future;
+};
+
+/**
+ * Shelf packer for atlas pages. Rectangles go into rows of similar height; removed
+ * rectangles return to their row's free spans, and empty rows at the bottom are released.
+ */
+class AtlasPacker {
+public:
+	AtlasPacker(int width, int height) : m_width(width), m_height(height) {}
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+	/**
+	 * @brief  Reserves a w x h rectangle
+	 * @retval Its position, or nullopt if the page is full
+	 */
+	std::optional<Rect> add(int w, int h) {
+		if (w <= 0 || h <= 0 || w > m_width || h > m_height) return std::nullopt;
+
+		// Best fit: the shortest shelf that has room, without wasting more than its half
+		Shelf* best = nullptr;
+		size_t bestSpan = 0;
+		for (Shelf& shelf : m_shelves) {
+			if (shelf.height < h || (shelf.height > h * 2 && !shelf.empty(m_width))) continue;
+			if (best && best->height <= shelf.height) continue;
+			for (size_t i = 0; i < shelf.free.size(); i++) {
+				if (shelf.free[i].width >= w) {
+					best = &shelf;
+					bestSpan = i;
+					break;
+				}
+			}
+		}
+
+		if (!best) {
+			if (m_top + h > m_height) return std::nullopt;
+			m_shelves.push_back(Shelf{ .y = m_top, .height = h, .free = { Span{ 0, m_width } } });
+			m_top += h;
+			best = &m_shelves.back();
+			bestSpan = 0;
+		}
+
+		Span& span = best->free[bestSpan];
+		Rect r(span.x, best->y, w, h);
+		span.x += w;
+		span.width -= w;
+		if (span.width == 0) best->free.erase(best->free.begin() + bestSpan);
+		return r;
+	}
+
+	/**
+	 * @brief  Releases a rectangle returned by add
+	 */
+	void remove(const Rect& r) {
+		auto it = std::find_if(m_shelves.begin(), m_shelves.end(), [&](const Shelf& s) { return s.y == r.y; });
+		if (it == m_shelves.end()) return;
+
+		// Free spans are kept sorted and merged with their neighbours
+		auto& free = it->free;
+		auto at = std::lower_bound(free.begin(), free.end(), r.x, [](const Span& s, int x) { return s.x < x; });
+		at = free.insert(at, Span{ r.x, r.width });
+		if (at + 1 != free.end() && at->x + at->width == (at + 1)->x) {
+			at->width += (at + 1)->width;
+			free.erase(at + 1);
+		}
+		if (at != free.begin() && (at - 1)->x + (at - 1)->width == at->x) {
+			(at - 1)->width += at->width;
+			free.erase(at);
+		}
+
+		while (!m_shelves.empty() && m_shelves.back().empty(m_width)) {
+			m_top = m_shelves.back().y;
+			m_shelves.pop_back();
+		}
+	}
+
+private:
+	struct Span {
+		int x, width;
+	};
+
+	struct Shelf {
+		int y, height;
+		std::vector<Span> free;
+
+		bool empty(int width) const { return free.size() == 1 && free[0].width == width; }
+	};
+
+	int m_width, m_height;
+	int m_top{ 0 };
+	std::vector<Shelf> m_shelves;
+};
+
+/**
+ * Samples with a min/max pyramid for drawing them at any zoom.
+ * Level k holds the range of every block of 2^k samples, so a range of n samples is
+ * covered exactly by at most two blocks per level, about 2 log2(n) reads. The
+ * pyramid takes about twice the samples' memory; build large ones off the UI thread.
+ */
+class PlotData {
+public:
+	struct Range {
+		float lo, hi;
+	};
+
+	PlotData() = default;
+
+	explicit PlotData(std::vector<float> samples) : m_samples(std::move(samples)) {
+		if (m_samples.size() < 2) return;
+
+		// The first level pairs samples, every further level pairs the one below
+		std::vector<Range> level((m_samples.size() + 1) / 2);
+		for (size_t i = 0; i < level.size(); i++) {
+			float a = m_samples[i * 2], b = m_samples[std::min(i * 2 + 1, m_samples.size() - 1)];
+			level[i] = Range{ std::min(a, b), std::max(a, b) };
+		}
+		m_levels.push_back(std::move(level));
+
+		while (m_levels.back().size() > 1) {
+			const std::vector<Range>& below = m_levels.back();
+			std::vector<Range> next((below.size() + 1) / 2);
+			for (size_t i = 0; i < next.size(); i++) {
+				const Range& a = below[i * 2];
+				const Range& b = below[std::min(i * 2 + 1, below.size() - 1)];
+				next[i] = Range{ std::min(a.lo, b.lo), std::max(a.hi, b.hi) };
+			}
+			m_levels.push_back(std::move(next));
+		}
+	}
+
+	size_t size() const { return m_samples.size(); }
+	const std::vector<float>& samples() const { return m_samples; }
+
+	/**
+	 * @brief  Lowest and highest sample in [from, to)
+	 * @note   Exact: blocks only partly inside the range are split at the levels below,
+	 *         down to single samples at the ends
+	 * @retval {0, 0} for an empty range
+	 */
+	Range range(size_t from, size_t to) const {
+		to = std::min(to, m_samples.size());
+		if (from >= to) return Range{ 0.0f, 0.0f };
+
+		Range r{ m_samples[from], m_samples[from] };
+		auto add = [&r](const Range& b) {
+			r.lo = std::min(r.lo, b.lo);
+			r.hi = std::max(r.hi, b.hi);
+		};
+
+		// Unpaired samples at the ends, then walking up, the unpaired block at either end
+		// of each level; what's left between them is covered by the level above
+		if (from & 1) {
+			add(Range{ m_samples[from], m_samples[from] });
+			from++;
+		}
+		if (to & 1) {
+			to--;
+			add(Range{ m_samples[to], m_samples[to] });
+		}
+		from >>= 1;
+		to >>= 1;
+		for (size_t level = 0; from < to; level++) {
+			const std::vector<Range>& blocks = m_levels[level];
+			if (from & 1) add(blocks[from++]);
+			if (to & 1) add(blocks[--to]);
+			from >>= 1;
+			to >>= 1;
+		}
+		return r;
+	}
+
+	Range range() const { return range(0, m_samples.size()); }
+
+	/**
+	 * @brief  Linearly interpolated sample at a fractional position, clamped to the data
+	 */
+	float at(double pos) const {
+		if (m_samples.empty()) return 0.0f;
+		pos = std::clamp(pos, 0.0, double(m_samples.size() - 1));
+		size_t i = size_t(pos);
+		size_t j = std::min(i + 1, m_samples.size() - 1);
+		float t = float(pos - double(i));
+		return m_samples[i] + (m_samples[j] - m_samples[i]) * t;
+	}
+
+private:
+	std::vector<float> m_samples;
+	std::vector<std::vector<Range>> m_levels; // m_levels[k] has blocks of 2^(k + 1)
+};
+
+/**
+ * Fixed set of threads running jobs in submission order
+ */
+class WorkerPool {
+public:
+	explicit WorkerPool(unsigned threads) {
+		for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+			m_threads.emplace_back([this]() {
+				UI_PROFILE_THREAD("worker");
+				run();
+			});
+		}
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Finishes the jobs already submitted
+	~WorkerPool() {
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (auto& t : m_threads) t.join();
+	}
+
+	void submit(std::function<void()> job) {
+		{
+			std::lock_guard lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+		m_wake.notify_one();
+	}
+
+private:
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stop{ false };
+
+	void run() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock lock(m_mutex);
+				m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+				if (m_jobs.empty()) return;
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			job();
+		}
+	}
+};
+
+using ImageID = uint32_t;
+
+class Device {
+public:
+	Device(SDL_Window* window, SDL_Renderer* renderer) : m_window(window), m_renderer(renderer) {
+		SDL_StartTextInput();
+		m_statsFrequency = double(SDL_GetPerformanceFrequency()) / 1000.0;
+		queryRenderer();
+	}
+
+	/**
+	 * @brief  Creates a Device that submits and presents frames on a dedicated render thread
+	 * @note   The render thread creates the renderer, owns every texture and destroys it all
+	 *         with the Device; the calling thread only records frames and keeps the window
+	 *         and its events. flush() hands the frame over and returns, so the next frame is
+	 *         recorded while this one is drawn. It blocks once depth frames are waiting, which
+	 *         bounds the added latency. Submit-side statistics and latencies arrive up to
+	 *         depth frames late.
+	 *         Platforms where only the main thread may render (macOS) need the other constructor.
+	 * @param  window: Window to render to
+	 * @param  flags: SDL_CreateRenderer flags
+	 * @param  depth: Frames in flight, at least 1
+	 * @retval nullptr if the renderer can't be created; SDL_GetError() says why
+	 */
+	static std::unique_ptr<Device> pipelined(SDL_Window* window, Uint32 flags, int depth) {
+		std::unique_ptr<Device> dev(new Device(window, nullptr));
+		dev->startPipeline(std::max(depth, 1));
+
+		std::string error;
+		dev->renderSync([&]() {
+			dev->m_renderer = SDL_CreateRenderer(window, -1, flags);
+			if (dev->m_renderer) dev->queryRenderer();
+			else error = SDL_GetError();
+		});
+		if (!dev->m_renderer) {
+			SDL_SetError("%s", error.c_str());
+			return nullptr;
+		}
+		dev->m_ownsRenderer = true;
+		return dev;
+	}
+
+	~Device() {
+		m_imageLoader.reset();
+		for (auto& [id, surface] : m_loadedImages) SDL_FreeSurface(surface);
+		for (auto& [id, surface] : m_imageSources) SDL_FreeSurface(surface);
+		renderSync([this]() {
+			runRenderJobs(m_jobs);
+			clearPatchCache();
+			clearGlyphPages();
+			for (SDL_Texture* tex : m_atlasTextures) {
+				if (tex) SDL_DestroyTexture(tex);
+			}
+			SDL_DestroyTexture(m_theme);
+			if (m_ownsRenderer) SDL_DestroyRenderer(m_renderer);
+		});
+		stopPipeline();
+		if (m_dumpLatency) m_latency.print(stderr, "input latency");
+	}
+
+	int pipelineDepth() const { return m_pipeline ? int(m_pipeline->frames.size()) : 0; }
+
+	/**
+	 * @brief  Loads a skin texture
+	 * @note   Must be in BMP format. Skins already loaded by another Device are shared.
+	 * @param  path: Image path
+	 * @retval false if it can't be read; the current skin is kept and skinError() says why
+	 */
+	bool loadSkin(const std::string& path) {
+		auto skin = Skin::load(path);
+		if (!skin) {
+			m_skinError = "Can't load skin " + path;
+			return false;
+		}
+		setSkin(std::move(skin));
+		return true;
+	}
+
+	/**
+	 * @brief  Loads a skin on a background thread
+	 * @note   Decoding and the glyph scan run off the UI thread; the texture is created and
+	 *         the skin swapped in by the first present() after it's done. The file is always
+	 *         read again, so this also reloads an edited skin.
+	 * @param  path: Image path
+	 * @retval None
+	 */
+	void loadSkinAsync(const std::string& path) {
+		m_stagedSkinPath = path;
+		m_stagedSkin.start([path]() { return Skin::load(path, true); });
+	}
+
+	bool loadingSkin() const { return m_stagedSkin.pending(); }
+
+	/**
+	 * @brief  Why the last skin load failed
+	 * @note   Until a skin is loaded, text and skin cells draw nothing
+	 * @retval Empty if the last load succeeded
+	 */
+	const std::string& skinError() const { return m_skinError; }
+
+	/**
+	 * @brief  Uses a loaded skin, creating this renderer's texture for it
+	 * @note   Glyph pages get their textures when first drawn
+	 * @param  skin: Skin, possibly shared with other Devices
+	 * @retval None
+	 */
+	void setSkin(std::shared_ptr<const Skin> skin) {
+		if (!skin) return;
+		// Textures belong to the render thread, so a pipelined Device drains its frames here
+		renderSync([&]() {
+			if (m_theme) {
+				SDL_DestroyTexture(m_theme);
+			}
+			clearPatchCache();
+			clearGlyphPages();
+
+			m_skin = std::move(skin);
+			m_theme = SDL_CreateTextureFromSurface(m_renderer, m_skin->base().surface);
+			SDL_QueryTexture(m_theme, nullptr, nullptr, &m_themeWidth, &m_themeHeight);
+		});
+		m_skinError.clear();
+		m_generation++;
+	}
+
+	const std::shared_ptr<const Skin>& skin() const { return m_skin; }
+
+	/**
+	 * @brief  Measures a single line of UTF-8 text
+	 * @param  str: Text
+	 * @param  mask: If not 0, every character is measured as this one
+	 * @retval Width in pixels
+	 */
+	int textWidth(std::string_view str, char mask = 0) {
+		if (!m_skin) return 0;
+		int acc = 0;
+		for (size_t i = 0; i < str.size();) {
+			uint32_t cp = utf8Next(str, i);
+			acc += glyph(mask ? uint8_t(mask) : cp).advance();
+		}
+		return acc;
+	}
+
+	void debugRect(int x, int y, int w, int h) {
+		pushRecord(RectRecord{ .type = CmdDebug, .x = clamp16(x), .y = clamp16(y), .w = clamp16(w), .h = clamp16(h) });
+	}
+
+	/**
+	 * @brief  Draws a base page cell by index, e.g. 219 for the solid block
+	 * @retval Horizontal advance in pixels
+	 */
+	int drawChar(char c, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+		if (!m_skin) return 0;
+		return drawGlyph(Glyph{ &m_skin->base(), 0, uint8_t(c) }, x, y, r, g, b);
+	}
+
+	/**
+	 * @brief  Draws a single code point
+	 * @note   Code points without a glyph are drawn as '?'
+	 * @retval Horizontal advance in pixels
+	 */
+	int drawGlyph(uint32_t cp, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+		if (!m_skin) return 0;
+		return drawGlyph(glyph(cp), x, y, r, g, b);
+	}
+
+	void drawTileSection(int index, int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, int rx, int ry, int rw, int rh) {
+		SDL_Rect src = tileSource(index, rx, ry, rw, rh);
+		pushDraw(x, y, w, h, src.x, src.y, src.w, src.h, r, g, b);
+	}
+
+	void drawText(std::string_view str, int x, int y, uint8_t r, uint8_t g, uint8_t b, char mask = 0) {
+		if (!m_skin) return;
+		const Rect* clip = activeClip();
+
+		int tx = 0, ty = 0;
+		bool lineDone = false;
+		for (size_t i = 0; i < str.size();) {
+			uint32_t cp = utf8Next(str, i);
+			if (mask) cp = uint8_t(mask);
+			if (cp == '\n') {
+				tx = 0;
+				ty += cellHeight() + m_charSpacingY;
+				lineDone = false;
+			} else if (lineDone) {
+				continue;
+			} else if (cp < 0x80 && isspace(int(cp))) {
+				tx += glyph(cp).advance();
+			} else if (clip) {
+				// Skip glyphs scrolled out of the clip without recording them
+				Glyph gl = glyph(cp);
+				int gx = tx + x - gl.page->offsetX[gl.cell];
+				if (gx >= clip->x + clip->width) {
+					lineDone = true;
+				} else if (gx + gl.page->cellWidth <= clip->x) {
+					tx += gl.advance();
+				} else {
+					tx += drawGlyph(cp, tx + x, ty + y, r, g, b);
+				}
+			} else {
+				tx += drawGlyph(cp, tx + x, ty + y, r, g, b);
+			}
+		}
+	}
+
+	/**
+	 * @brief  Draws one-pixel wide vertical bars in a solid color, as a single batched command
+	 * @note   Used for meters and waveforms; adjacent equal columns are merged at submission
+	 * @param  x: Left of the first column
+	 * @param  y: Origin the spans are relative to
+	 * @param  spans: (top, bottom) pairs, inclusive, one per column
+	 * @param  count: Number of columns
+	 * @retval None
+	 */
+	void drawColumns(int x, int y, const int16_t* spans, int count, uint8_t r, uint8_t g, uint8_t b) {
+		if (count <= 0) return;
+		count = std::min(count, int(UINT16_MAX));
+
+		const Rect* clip = activeClip();
+		if (clip) {
+			int16_t top = INT16_MAX, bottom = INT16_MIN;
+			for (int i = 0; i < count; i++) {
+				top = std::min(top, spans[i * 2]);
+				bottom = std::max(bottom, spans[i * 2 + 1]);
+			}
+			if (!clip->overlaps(Rect(x, y + top, count, bottom - top + 1))) {
+				if (m_statsEnabled) m_stats.culled++;
+				return;
+			}
+		}
+		if (!fits16(x, y, count, 0)) return;
+
+		pushRecord(ColumnsRecord{ .type = CmdColumns, .r = r, .g = g, .b = b, .x = int16_t(x), .y = int16_t(y), .count = uint16_t(count) });
+		pushPayload(spans, size_t(count) * 2 * sizeof(int16_t));
+	}
+
+	/**
+	 * @brief  Draws a nine-patch from a skin cell
+	 * @note   Recorded as a single command and expanded at submission
+	 * @retval None
+	 */
+	void drawPatch(int index, int x, int y, int w, int h, uint8_t r = 0xFF, uint8_t g = 0xFF, uint8_t b = 0xFF) {
+		const Rect* clip = activeClip();
+		if (clip && !clip->overlaps(Rect(x, y, w, h))) {
+			if (m_statsEnabled) m_stats.culled++;
+			return;
+		}
+
+		if (!fits16(x, y, w, h)) {
+			forEachPatchSection(x, y, w, h, [&](int sx, int sy, int sw, int sh, int rx, int ry, int rw, int rh) {
+				drawTileSection(index, sx, sy, sw, sh, r, g, b, rx, ry, rw, rh);
+			});
+			return;
+		}
+
+		pushRecord(PatchRecord{
+			.type = CmdPatch, .index = uint8_t(index & 0xFF), .r = r, .g = g, .b = b,
+			.x = clamp16(x), .y = clamp16(y), .w = clamp16(w), .h = clamp16(h)
+		});
+	}
+
+	void drawBalloon(int x, int y, int width, int height) {
+		drawPatch(8, x - width / 2, y + 4, width, height);
+		drawPatch(9, x - cellWidth() / 2, y - (cellHeight() - 4), cellWidth(), cellHeight());
+	}
+
+	/**
+	 * @brief  Copies an image into an atlas page
+	 * @note   Only the image's rectangle is uploaded. Images share pages, so runs of
+	 *         them draw from the same texture. The pixels are copied, the caller keeps
+	 *         its surface.
+	 * @param  surface: Pixels, in any format
+	 * @retval Image id, or 0 if it can't be added (including images larger than the
+	 *         renderer's maximum texture size)
+	 */
+	ImageID addImage(SDL_Surface* surface) {
+		SDL_Surface* source = surface ? SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0) : nullptr;
+		ImageID id = m_nextImage;
+		if (!placeImage(id, source)) {
+			if (source) SDL_FreeSurface(source);
+			return 0;
+		}
+		m_imageSources.emplace(id, source);
+		m_nextImage++;
+		return id;
+	}
+
+	/**
+	 * @brief  Loads a BMP image into the atlas, once per path
+	 * @note   The file is decoded on a background thread and added by the first present()
+	 *         after it's done, which also changes generation() so layouts pick up its size.
+	 *         Until then the image has no size and draws nothing.
+	 * @retval Image id, or 0 for an empty path
+	 */
+	ImageID image(const std::string& path) {
+		if (path.empty()) return 0;
+		auto it = m_imagePaths.find(path);
+		if (it != m_imagePaths.end()) return it->second;
+
+		ImageID id = m_nextImage++;
+		m_imagePaths.emplace(path, id);
+		m_imageLoads.insert(id);
+
+		if (!m_imageLoader) m_imageLoader = std::make_unique<WorkerPool>(1);
+		m_imageLoader->submit([this, id, path]() {
+			UI_PROFILE_SCOPE("Device::loadImage");
+			SDL_Surface* surf = SDL_LoadBMP(path.c_str());
+			SDL_Surface* conv = surf ? SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0) : nullptr;
+			if (surf) SDL_FreeSurface(surf);
+
+			std::lock_guard lock(m_loadedMutex);
+			m_loadedImages.emplace_back(id, conv);
+		});
+		return id;
+	}
+
+	bool loadingImages() const { return !m_imageLoads.empty(); }
+
+	/**
+	 * @brief  Replaces an image's pixels in place (e.g. a redrawn waveform)
+	 * @retval false if the image doesn't exist or the size differs
+	 */
+	bool updateImage(ImageID id, SDL_Surface* surface) {
+		auto it = m_images.find(id);
+		if (it == m_images.end() || !surface) return false;
+		if (surface->w != it->second.rect.width || surface->h != it->second.rect.height) return false;
+		SDL_Surface* source = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+		if (!source) return false;
+		SDL_FreeSurface(m_imageSources[id]);
+		m_imageSources[id] = source;
+		uploadImage(it->second, source);
+		return true;
+	}
+
+	/**
+	 * @brief  Frees an image's atlas space for later images
+	 * @note   Invalidates recorded display lists, which may refer to it
+	 */
+	void removeImage(ImageID id) {
+		std::erase_if(m_imagePaths, [&](const auto& p) { return p.second == id; });
+		m_imageLoads.erase(id);
+		if (auto source = m_imageSources.find(id); source != m_imageSources.end()) {
+			SDL_FreeSurface(source->second);
+			m_imageSources.erase(source);
+		}
+
+		auto it = m_images.find(id);
+		if (it == m_images.end()) return;
+		const AtlasImage& image = it->second;
+		m_atlasPages[image.page].packer.remove(image.slot);
+
+		// Cleared, padding included, so an image placed here later doesn't bleed old pixels
+		renderJob([this, page = image.page, slot = image.slot]() {
+			if (page >= m_atlasTextures.size() || !m_atlasTextures[page]) return;
+			std::vector<uint32_t> clear(size_t(slot.width) * size_t(slot.height), 0);
+			SDL_Rect dst = { slot.x, slot.y, slot.width, slot.height };
+			SDL_UpdateTexture(m_atlasTextures[page], &dst, clear.data(), slot.width * int(sizeof(uint32_t)));
+		});
+		m_images.erase(it);
+		m_generation++;
+	}
+
+	std::pair<int, int> imageSize(ImageID id) const {
+		auto it = m_images.find(id);
+		if (it == m_images.end()) return { 0, 0 };
+		return { it->second.rect.width, it->second.rect.height };
+	}
+
+	void drawImage(ImageID id, int x, int y, int w, int h, uint8_t r = 0xFF, uint8_t g = 0xFF, uint8_t b = 0xFF) {
+		auto it = m_images.find(id);
+		if (it == m_images.end()) return;
+		const Rect& src = it->second.rect;
+		pushDraw(x, y, w, h, src.x, src.y, src.width, src.height, r, g, b, uint16_t(AtlasPageBase + it->second.page));
+	}
+
+	/**
+	 * @brief  Pushes a clip rectangle, intersected with the current one
+	 * @note   Draws entirely outside the effective clip are dropped while recording
+	 * @retval None
+	 */
+	void clip(int x, int y, int w, int h) {
+		Rect eff(x, y, w, h);
+		if (!m_recordClips.empty()) eff = eff.intersect(m_recordClips.back());
+		m_recordClips.push_back(eff);
+
+		pushRecord(RectRecord{
+			.type = CmdClip, .x = clamp16(eff.x), .y = clamp16(eff.y), .w = clamp16(eff.width), .h = clamp16(eff.height)
+		});
+	}
+
+	void unclip() {
+		if (m_recordClips.size() > (m_clipFloors.empty() ? 0 : m_clipFloors.top())) {
+			m_recordClips.pop_back();
+		}
+		pushRecord(UnClipRecord{ .type = CmdUnClip });
+	}
+
+	/**
+	 * @brief  Submits the recorded frame
+	 * @note   When pipelined, the frame is handed to the render thread instead, after
+	 *         waiting for one of the queued frames to be presented if the queue is full
+	 * @retval None
+	 */
+	void flush() {
+		UI_PROFILE_SCOPE("Device::flush");
+		if (m_pipeline) queueFrame();
+		else submit(m_arena, m_spans, m_statsEnabled ? &m_stats : nullptr);
+
+		m_arena.clear();
+		m_spans.clear();
+		m_spanOpen = false;
+		while (!m_orderStack.empty()) m_orderStack.pop();
+		while (!m_clipFloors.empty()) m_clipFloors.pop();
+		m_recordClips.clear();
+		m_currentOrder = 0;
+	}
+
+	/**
+	 * @brief  Notes an input event consumed by the frame being built
+	 * @note   Its latency is recorded when the frame is presented
+	 * @param  timestamp: SDL event timestamp (SDL_GetTicks() at arrival)
+	 * @retval None
+	 */
+	void inputConsumed(uint32_t timestamp) {
+		// Events carry millisecond ticks; convert to the performance counter at dispatch
+		uint64_t now = SDL_GetPerformanceCounter();
+		uint32_t waited = timestamp ? SDL_GetTicks() - timestamp : 0;
+		uint64_t queued = uint64_t(double(waited) * m_statsFrequency);
+		m_pendingInputs.push_back(now > queued ? now - queued : 0);
+	}
+
+	/**
+	 * @brief  Input-to-present latency of every event since the histogram was reset
+	 */
+	const LatencyHistogram& latency() const { return m_latency; }
+	void resetLatency() { m_latency.reset(); }
+
+	/**
+	 * @brief  Prints the latency histogram to stderr when the Device is destroyed
+	 */
+	void dumpLatencyOnExit(bool dump) { m_dumpLatency = dump; }
+
+	/**
+	 * @brief  Presents the rendered frame and closes the frame statistics
+	 * @note   Use this instead of calling SDL_RenderPresent directly. When pipelined, the
+	 *         frame handed over by flush() is presented by the render thread instead.
+	 * @retval None
+	 */
+	void present() {
+		UI_PROFILE_SCOPE("Device::present");
+		// When pipelined, the render thread presents the frame and measures its latency
+		if (!m_pipeline) {
+			uint64_t t0 = statsBegin();
+			SDL_RenderPresent(m_renderer);
+			statsEnd(FrameStats::PhasePresent, t0);
+
+			uint64_t presented = SDL_GetPerformanceCounter();
+			for (uint64_t origin : m_pendingInputs) m_latency.record(latencySince(origin, presented));
+			m_pendingInputs.clear();
+		}
+		uint64_t now = SDL_GetPerformanceCounter();
+
+		// Between frames, so nothing recorded refers to the previous skin's texture
+		if (auto skin = m_stagedSkin.take()) {
+			if (*skin) setSkin(std::move(*skin));
+			else m_skinError = "Can't load skin " + m_stagedSkinPath;
+		}
+		placeLoadedImages();
+
+		if (!m_statsEnabled) return;
+
+		if (m_statsLastPresent) {
+			m_frameTimes[m_frameIndex] = float(double(now - m_statsLastPresent) / m_statsFrequency);
+			m_frameIndex = (m_frameIndex + 1) % FrameStats::HistorySize;
+		}
+		m_statsLastPresent = now;
+
+		m_lastStats = m_stats;
+		m_stats.reset();
+	}
+
+	/**
+	 * @brief  Draws the frame statistics of the previous frame
+	 * @note   Does nothing unless statistics are enabled
+	 * @param  x: Overlay left position
+	 * @param  y: Overlay top position
+	 * @retval None
+	 */
+	void drawStats(int x = 4, int y = 4) {
+		if (!m_statsEnabled || !m_skin) return;
+
+		static const char* phaseNames[] = { "events", "layout", "record", "sort", "flush", "present" };
+
+		const int lineH = cellHeight() + m_charSpacingY;
+		const int graphH = 32;
+		const int width = 176;
+		const int height = lineH * (FrameStats::PhaseCount + 7) + graphH + GraphPadding * 3;
+
+		const FrameStats& s = m_lastStats;
+
+		pushOrder(StatsOrder);
+		drawPatch(6, x, y, width, height);
+
+		char buf[64];
+		int ty = y + GraphPadding;
+		for (int i = 0; i < FrameStats::PhaseCount; i++) {
+			std::snprintf(buf, sizeof(buf), "%-8s %6.2f ms", phaseNames[i], s.phases[i]);
+			drawText(buf, x + GraphPadding, ty, 255, 255, 255);
+			ty += lineH;
+		}
+
+		std::snprintf(buf, sizeof(buf), "draw %d patch %d", s.commands[CmdDraw], s.commands[CmdPatch]);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH;
+
+		std::snprintf(buf, sizeof(buf), "clip %d/%d debug %d", s.commands[CmdClip], s.commands[CmdUnClip], s.commands[CmdDebug]);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH;
+
+		std::snprintf(buf, sizeof(buf), "calls %d widgets %d", s.drawCalls, s.widgetsVisited);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH;
+
+		std::snprintf(buf, sizeof(buf), "bytes %d culled %d", s.commandBytes, s.culled);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH;
+
+		std::snprintf(buf, sizeof(buf), "patch hit %d miss %d", s.patchCacheHits, s.patchCacheMisses);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH;
+
+		std::snprintf(buf, sizeof(buf), "list hit %d miss %d", s.listHits, s.listMisses);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH;
+
+		std::snprintf(buf, sizeof(buf), "input p50 %.1f p99 %.1f", m_latency.percentile(50) / 1000.0, m_latency.percentile(99) / 1000.0);
+		drawText(buf, x + GraphPadding, ty, 200, 200, 200);
+		ty += lineH + GraphPadding;
+
+		// Frame time graph, one bar per recorded frame scaled to 33ms
+		const int barW = (width - GraphPadding * 2) / FrameStats::HistorySize;
+		for (int i = 0; i < FrameStats::HistorySize; i++) {
+			float ft = m_frameTimes[(m_frameIndex + i) % FrameStats::HistorySize];
+			int bh = std::clamp(int(ft / 33.0f * graphH), 0, graphH);
+			if (bh == 0) continue;
+
+			uint8_t red = ft > 16.7f ? 255 : 80;
+			drawTileSection(
+				SolidCell,
+				x + GraphPadding + i * barW, ty + graphH - bh, barW, bh,
+				red, 255 - red / 2, 80,
+				0, 0, cellWidth(), cellHeight()
+			);
+		}
+		popOrder();
+	}
+
+	bool statsEnabled() const { return m_statsEnabled; }
+	void statsEnabled(bool enabled) {
+		m_statsEnabled = enabled;
+		m_statsLastPresent = 0;
+		m_stats.reset();
+		m_lastStats.reset();
+	}
+
+	FrameStats& stats() { return m_stats; }
+	const FrameStats& lastStats() const { return m_lastStats; }
+
+	/**
+	 * @brief  Starts timing a frame phase
+	 * @retval Performance counter, or 0 if statistics are disabled
+	 */
+	uint64_t statsBegin() const {
+		return m_statsEnabled ? SDL_GetPerformanceCounter() : 0;
+	}
+
+	/**
+	 * @brief  Accumulates the time elapsed since statsBegin into a phase
+	 * @param  phase: Frame phase
+	 * @param  start: Value returned by statsBegin
+	 * @retval None
+	 */
+	void statsEnd(FrameStats::Phase phase, uint64_t start) {
+		if (!m_statsEnabled) return;
+		m_stats.phases[phase] += double(SDL_GetPerformanceCounter() - start) / m_statsFrequency;
+	}
+
+	void pushOrder(int base) {
+		m_orderStack.push(m_currentOrder);
+		m_currentOrder = base;
+		m_spanOpen = false;
+
+		// Reordered commands are submitted outside of the current clips
+		m_clipFloors.push(m_recordClips.size());
+		m_recordClips.push_back(Unclipped);
+	}
+
+	void popOrder() {
+		if (m_orderStack.empty()) return;
+		m_currentOrder = m_orderStack.top();
+		m_orderStack.pop();
+		m_spanOpen = false;
+
+		if (!m_clipFloors.empty()) {
+			m_recordClips.resize(m_clipFloors.top());
+			m_clipFloors.pop();
+		}
+	}
+
+	/**
+	 * @brief  Starts recording commands into a retained display list
+	 * @note   Captures don't nest. The list stays valid for the same bounds, version,
+	 *         effective clip and device generation
+	 * @param  key: Display list key (a widget id)
+	 * @param  bounds: Bounds the commands are recorded for
+	 * @param  version: Caller's version of the recorded state
+	 * @retval None
+	 */
+	void beginCapture(uint32_t key, const Rect& bounds, uint32_t version) {
+		// A fresh span keeps the list independent of the commands around it
+		m_spanOpen = false;
+		m_recordPage = 0;
+		m_capture = Capture{
+			.key = key, .version = version, .bounds = bounds,
+			.arena = uint32_t(m_arena.size()), .spans = m_spans.size(),
+			.order = m_currentOrder, .depth = m_orderStack.size(), .active = true
+		};
+		m_captureAbsolute.clear();
+	}
+
+	void endCapture() {
+		if (!m_capture.active) return;
+		m_capture.active = false;
+		m_spanOpen = false;
+
+		DisplayList& list = m_displayLists[m_capture.key];
+		list.bytes.assign(m_arena.begin() + m_capture.arena, m_arena.end());
+		list.spans.clear();
+		for (size_t i = m_capture.spans; i < m_spans.size(); i++) {
+			const Span& span = m_spans[i];
+			const bool relative = !m_captureAbsolute[i - m_capture.spans];
+			list.spans.push_back(ListSpan{
+				.order = relative ? span.order - m_capture.order : span.order,
+				.begin = span.begin - m_capture.arena, .end = span.end - m_capture.arena,
+				.relative = relative
+			});
+		}
+		list.orders = m_currentOrder - m_capture.order;
+		list.bounds = m_capture.bounds;
+		list.clip = currentClip();
+		list.version = m_capture.version;
+		list.generation = m_generation;
+	}
+
+	/**
+	 * @brief  Re-emits a display list recorded by beginCapture/endCapture
+	 * @note   Orders are rebased onto the current order, except for spans recorded under pushOrder
+	 * @retval false if there's no list or it's stale, in which case the caller records again
+	 */
+	bool replay(uint32_t key, const Rect& bounds, uint32_t version) {
+		auto it = m_displayLists.find(key);
+		if (it == m_displayLists.end()) return false;
+
+		const DisplayList& list = it->second;
+		if (list.version != version || list.generation != m_generation || !(list.bounds == bounds) || !(list.clip == currentClip())) {
+			if (m_statsEnabled) m_stats.listMisses++;
+			return false;
+		}
+
+		uint32_t base = uint32_t(m_arena.size());
+		m_arena.insert(m_arena.end(), list.bytes.begin(), list.bytes.end());
+		for (const ListSpan& span : list.spans) {
+			m_spans.push_back(Span{
+				.order = span.relative ? m_currentOrder + span.order : span.order,
+				.begin = base + span.begin, .end = base + span.end
+			});
+		}
+		m_currentOrder += list.orders;
+		m_spanOpen = false;
+		m_recordPage = 0;
+
+		if (m_statsEnabled) m_stats.listHits++;
+		return true;
+	}
+
+	void discardDisplayList(uint32_t key) { m_displayLists.erase(key); }
+	void clearDisplayLists() { m_displayLists.clear(); }
+
+	/**
+	 * @brief  Recreates what the renderer lost on SDL_RENDER_TARGETS_RESET or SDL_RENDER_DEVICE_RESET
+	 * @note   Call from the event loop. A target reset only drops the patch cache. A device
+	 *         reset also recreates the skin texture and the atlas pages, and uploads every
+	 *         image again from its pixels under the same id.
+	 * @param  deviceLost: true for SDL_RENDER_DEVICE_RESET
+	 * @retval None
+	 */
+	void renderReset(bool deviceLost) {
+		renderSync([&]() {
+			clearPatchCache();
+			if (!deviceLost) return;
+
+			runRenderJobs(m_jobs);
+			clearGlyphPages();
+			for (SDL_Texture* tex : m_atlasTextures) {
+				if (tex) SDL_DestroyTexture(tex);
+			}
+			m_atlasTextures.clear();
+			if (m_theme) SDL_DestroyTexture(m_theme);
+			m_theme = m_skin ? SDL_CreateTextureFromSurface(m_renderer, m_skin->base().surface) : nullptr;
+		});
+		if (!deviceLost) return;
+
+		// Repacked, so images may move, but their ids and sizes stay
+		m_atlasPages.clear();
+		m_images.clear();
+		for (auto& [id, source] : m_imageSources) placeImage(id, source);
+		m_generation++;
+	}
+
+	int charSpacingX() const { return m_charSpacingX; }
+	void charSpacingX(int charSpacingX) { m_charSpacingX = charSpacingX; m_generation++; }
+
+	int charSpacingY() const { return m_charSpacingY; }
+	void charSpacingY(int charSpacingY) { m_charSpacingY = charSpacingY; m_generation++; }
+
+	int patchPadding() const { return m_patchPadding; }
+	void patchPadding(int patchPadding) {
+		renderSync([&]() {
+			if (patchPadding != m_patchPadding) clearPatchCache();
+			m_patchPadding = patchPadding;
+		});
+		m_generation++;
+	}
+
+	/**
+	 * @brief  Changes whenever the skin or text metrics change
+	 * @note   Layouts depending on text size must be recomputed when this changes
+	 */
+	int generation() const { return m_generation; }
+
+	size_t patchCacheBudget() const { return m_patchCacheBudget; }
+	void patchCacheBudget(size_t bytes) {
+		renderSync([&]() {
+			m_patchCacheBudget = bytes;
+			trimPatchCache(0);
+		});
+	}
+
+	const int& themeWidth() const { return m_themeWidth; }
+	const int& themeHeight() const { return m_themeHeight; }
+
+	int cellWidth() const { return m_themeWidth / 16; }
+	int cellHeight() const { return m_themeHeight / 16; }
+
+	std::pair<int, int> size() const {
+		int w, h;
+		SDL_GetWindowSize(m_window, &w, &h);
+		return std::make_pair(w, h);
+	}
+
+private:
+	// Commands are stored as variable-sized tagged records in a per-frame arena.
+	// Records are byte-packed and read back with memcpy, so no alignment is assumed.
+	enum CommandType : uint8_t {
+		CmdDraw = 0,
+		CmdClip,
+		CmdUnClip,
+		CmdDebug,
+		CmdPatch,
+		CmdDrawWide,
+		CmdTexture,
+		CmdColumns
+	};
+
+#pragma pack(push, 1)
+	struct DrawRecord {
+		CommandType type;
+		uint8_t r, g, b;
+		int16_t x, y, w, h;
+		int16_t rx, ry, rw, rh;
+	};
+
+	struct DrawWideRecord {
+		CommandType type;
+		uint8_t r, g, b;
+		int32_t x, y, w, h;
+		int16_t rx, ry, rw, rh;
+	};
+
+	struct PatchRecord {
+		CommandType type;
+		uint8_t index, r, g, b;
+		int16_t x, y, w, h;
+	};
+
+	struct RectRecord {
+		CommandType type;
+		int16_t x, y, w, h;
+	};
+
+	struct UnClipRecord {
+		CommandType type;
+	};
+
+	// Selects the glyph page following draws sample from; spans start on page 0 (the skin)
+	struct TextureRecord {
+		CommandType type;
+		uint16_t page;
+	};
+
+	// Followed by `count` (top, bottom) pairs relative to y, one per pixel column from x
+	struct ColumnsRecord {
+		CommandType type;
+		uint8_t r, g, b;
+		int16_t x, y;
+		uint16_t count;
+	};
+#pragma pack(pop)
+
+	using GlyphPage = Skin::GlyphPage;
+
+	struct Glyph {
+		const GlyphPage* page;
+		uint16_t pageIndex;
+		uint8_t cell;
+
+		int advance() const { return page->advance[cell] - page->offsetX[cell]; }
+	};
+
+	// A run of records with consecutive draw order
+	struct Span {
+		int order;
+		uint32_t begin, end;
+	};
+
+	static constexpr int StatsOrder = 1 << 30;
+	static constexpr int SolidCell = 219;
+	static constexpr int GraphPadding = 6;
+
+	// Pre-composited nine-patches, most recently used first
+	struct PatchCacheEntry {
+		uint64_t key;
+		SDL_Texture* texture;
+		size_t bytes;
+	};
+
+	std::list<PatchCacheEntry> m_patchCache;
+	std::unordered_map<uint64_t, std::list<PatchCacheEntry>::iterator> m_patchCacheIndex;
+	size_t m_patchCacheBytes{ 0 }, m_patchCacheBudget{ 8 * 1024 * 1024 };
+
+	std::vector<uint8_t> m_arena;
+	std::vector<Span> m_spans;
+	bool m_spanOpen{ false };
+	std::stack<int, std::vector<int>> m_orderStack;
+
+	// Retained per-widget commands, with span orders relative to the list start
+	struct ListSpan {
+		int order;
+		uint32_t begin, end;
+		bool relative;
+	};
+
+	struct DisplayList {
+		std::vector<uint8_t> bytes;
+		std::vector<ListSpan> spans;
+		int orders{ 0 };
+		Rect bounds, clip;
+		uint32_t version{ 0 };
+		int generation{ 0 };
+	};
+
+	struct Capture {
+		uint32_t key{ 0 }, version{ 0 };
+		Rect bounds;
+		uint32_t arena{ 0 };
+		size_t spans{ 0 };
+		int order{ 0 };
+		size_t depth{ 0 };
+		bool active{ false };
+	};
+
+	std::unordered_map<uint32_t, DisplayList> m_displayLists;
+	Capture m_capture;
+	std::vector<uint8_t> m_captureAbsolute;
+
+	// Effective clip rectangles while recording, with the stack depth at each pushOrder
+	static inline const Rect Unclipped{ -(1 << 28), -(1 << 28), 1 << 29, 1 << 29 };
+	std::vector<Rect> m_recordClips;
+	std::stack<size_t, std::vector<size_t>> m_clipFloors;
+	std::stack<Rect, std::vector<Rect>> m_clips;
+	int m_currentOrder{ 0 };
+
+	std::shared_ptr<const Skin> m_skin;
+	Staged<std::shared_ptr<const Skin>> m_stagedSkin;
+	std::string m_stagedSkinPath, m_skinError;
+
+	// Image atlas pages follow the glyph pages in texture record numbering
+	static constexpr uint32_t AtlasPageBase = 0xF000;
+	static constexpr size_t AtlasPageCount = 0x1000;
+	static constexpr int AtlasPageSize = 1024;
+
+	// Packing happens on the UI thread; the textures are the render thread's
+	struct AtlasPage {
+		AtlasPacker packer;
+	};
+
+	struct AtlasImage {
+		uint16_t page;
+		Rect slot, rect; // reserved (padded) and drawn
+	};
+
+	std::vector<AtlasPage> m_atlasPages;
+	std::vector<SDL_Texture*> m_atlasTextures;
+	std::unordered_map<ImageID, AtlasImage> m_images;
+	std::unordered_map<ImageID, SDL_Surface*> m_imageSources; // ARGB8888 copies, kept for device resets
+	std::unordered_map<std::string, ImageID> m_imagePaths;
+	ImageID m_nextImage{ 1 };
+	int m_maxTextureWidth{ INT_MAX }, m_maxTextureHeight{ INT_MAX };
+
+	// Images being decoded by the loader, and those it finished
+	std::unordered_set<ImageID> m_imageLoads;
+	std::unique_ptr<WorkerPool> m_imageLoader;
+	std::mutex m_loadedMutex;
+	std::vector<std::pair<ImageID, SDL_Surface*>> m_loadedImages, m_placingImages;
+
+	bool placeImage(ImageID id, SDL_Surface* surface) {
+		if (!surface) return false;
+
+		// Images are padded by a pixel so scaled draws don't bleed into their neighbours
+		const int w = surface->w + 1, h = surface->h + 1;
+		if (w > m_maxTextureWidth || h > m_maxTextureHeight) return false;
+
+		std::optional<Rect> rect;
+		size_t page = 0;
+		for (; page < m_atlasPages.size() && !rect; page++) rect = m_atlasPages[page].packer.add(w, h);
+		if (rect) page--;
+		else {
+			if (m_atlasPages.size() >= AtlasPageCount) return false;
+			const int pw = std::max(std::min(AtlasPageSize, m_maxTextureWidth), w);
+			const int ph = std::max(std::min(AtlasPageSize, m_maxTextureHeight), h);
+			renderJob([this, pw, ph]() { m_atlasTextures.push_back(createAtlasPage(pw, ph)); });
+			m_atlasPages.push_back(AtlasPage{ .packer = AtlasPacker(pw, ph) });
+			page = m_atlasPages.size() - 1;
+			rect = m_atlasPages[page].packer.add(w, h);
+		}
+
+		m_images[id] = AtlasImage{ .page = uint16_t(page), .slot = *rect, .rect = Rect(rect->x, rect->y, surface->w, surface->h) };
+		uploadImage(m_images[id], surface);
+		return true;
+	}
+
+	void placeLoadedImages() {
+		{
+			std::lock_guard lock(m_loadedMutex);
+			if (m_loadedImages.empty()) return;
+			std::swap(m_loadedImages, m_placingImages);
+		}
+
+		// Images removed while loading are discarded; the others keep their pixels
+		for (auto& [id, surface] : m_placingImages) {
+			if (m_imageLoads.erase(id) && placeImage(id, surface)) m_imageSources.emplace(id, surface);
+			else if (surface) SDL_FreeSurface(surface);
+		}
+		m_placingImages.clear();
+		m_generation++;
+	}
+
+	SDL_Texture* createAtlasPage(int w, int h) {
+		SDL_Texture* tex = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, w, h);
+		if (!tex) return nullptr;
+		SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+
+		// The only full upload: pages start transparent
+		std::vector<uint32_t> clear(size_t(w) * size_t(h), 0);
+		SDL_UpdateTexture(tex, nullptr, clear.data(), w * int(sizeof(uint32_t)));
+		return tex;
+	}
+
+	void uploadImage(const AtlasImage& image, SDL_Surface* surface) {
+		// Copied now, since the source may change or go before the next submit uploads it
+		SDL_Surface* conv = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+		if (!conv) return;
+		SDL_Rect dst = { image.rect.x, image.rect.y, image.rect.width, image.rect.height };
+		renderJob([this, page = image.page, dst, conv]() {
+			if (page < m_atlasTextures.size() && m_atlasTextures[page]) {
+				SDL_UpdateTexture(m_atlasTextures[page], &dst, conv->pixels, conv->pitch);
+			}
+			SDL_FreeSurface(conv);
+		});
+	}
+
+	// This renderer's textures for glyph pages other than 0
+	std::unordered_map<uint32_t, SDL_Texture*> m_pageTextures;
+	uint32_t m_lastPageIndex{ 0 };
+	const GlyphPage* m_lastPage{ nullptr };
+	uint16_t m_recordPage{ 0 };
+	std::vector<SDL_Rect> m_columnRects;
+	SDL_Texture* m_submitTexture{ nullptr };
+
+	SDL_Renderer* m_renderer;
+	SDL_Window* m_window;
+
+	SDL_Texture* m_theme{ nullptr };
+	int m_themeWidth{ 0 }, m_themeHeight{ 0 };
+
+	int m_charSpacingX{ -4 }, m_charSpacingY{ -2 }, m_patchPadding{ 5 };
+	int m_generation{ 0 };
+
+	bool m_statsEnabled{ false };
+	FrameStats m_stats{}, m_lastStats{};
+	float m_frameTimes[FrameStats::HistorySize]{};
+	int m_frameIndex{ 0 };
+	uint64_t m_statsLastPresent{ 0 };
+
+	// Performance counter values at which pending inputs arrived
+	std::vector<uint64_t> m_pendingInputs;
+	LatencyHistogram m_latency;
+	bool m_dumpLatency{ false };
+	double m_statsFrequency{ 1.0 };
+
+	uint64_t latencySince(uint64_t origin, uint64_t now) const {
+		return now > origin ? uint64_t(double(now - origin) / m_statsFrequency * 1000.0) : 0;
+	}
+
+	// Pipelined submission: frames cycle between free, queued and being rendered
+	struct Frame {
+		std::vector<uint8_t> arena;
+		std::vector<Span> spans;
+		std::vector<uint64_t> inputs;
+		std::vector<uint64_t> latencies;
+		std::vector<std::function<void()>> jobs;
+		FrameStats stats{};
+		bool statsEnabled{ false };
+	};
+
+	struct Pipeline {
+		std::vector<std::unique_ptr<Frame>> frames;
+		std::vector<Frame*> free, queue;
+		std::mutex mutex;
+		std::condition_variable cv;
+		const std::function<void()>* sync{ nullptr };
+		bool stop{ false };
+		std::thread thread;
+	};
+
+	std::unique_ptr<Pipeline> m_pipeline;
+	bool m_ownsRenderer{ false };
+	// Renderer work queued by the UI thread, run before the next frame is submitted
+	std::vector<std::function<void()>> m_jobs;
+	FrameStats* m_submitStats{ nullptr };
+
+	void startPipeline(int depth) {
+		m_pipeline = std::make_unique<Pipeline>();
+		for (int i = 0; i < depth; i++) {
+			m_pipeline->frames.push_back(std::make_unique<Frame>());
+			m_pipeline->free.push_back(m_pipeline->frames.back().get());
+		}
+		m_pipeline->queue.reserve(depth);
+		m_pipeline->thread = std::thread([this]() { renderLoop(); });
+	}
+
+	void stopPipeline() {
+		if (!m_pipeline) return;
+		{
+			std::lock_guard lock(m_pipeline->mutex);
+			m_pipeline->stop = true;
+		}
+		m_pipeline->cv.notify_all();
+		m_pipeline->thread.join();
+		for (auto& frame : m_pipeline->frames) collect(*frame);
+		m_pipeline.reset();
+	}
+
+	// Runs where the renderer lives
+	void queryRenderer() {
+		SDL_RendererInfo info;
+		if (m_renderer && SDL_GetRendererInfo(m_renderer, &info) == 0) {
+			if (info.max_texture_width > 0) m_maxTextureWidth = info.max_texture_width;
+			if (info.max_texture_height > 0) m_maxTextureHeight = info.max_texture_height;
+		}
+	}
+
+	static void runRenderJobs(std::vector<std::function<void()>>& jobs) {
+		for (auto& job : jobs) job();
+		jobs.clear();
+	}
+
+	void renderJob(std::function<void()> job) {
+		if (m_pipeline) m_jobs.push_back(std::move(job));
+		else job();
+	}
+
+	/**
+	 * @brief  Runs fn where the renderer lives
+	 * @note   When pipelined, waits for the queued frames, then for fn on the render thread
+	 * @retval None
+	 */
+	void renderSync(const std::function<void()>& fn) {
+		if (!m_pipeline) {
+			fn();
+			return;
+		}
+		Pipeline& p = *m_pipeline;
+		std::unique_lock lock(p.mutex);
+		p.sync = &fn;
+		p.cv.notify_all();
+		p.cv.wait(lock, [&]() { return !p.sync; });
+	}
+
+	void queueFrame() {
+		Pipeline& p = *m_pipeline;
+		Frame* frame;
+		{
+			std::unique_lock lock(p.mutex);
+			p.cv.wait(lock, [&]() { return !p.free.empty(); });
+			frame = p.free.back();
+			p.free.pop_back();
+		}
+
+		// The frame's buffers come back empty, so steady frames swap without allocating
+		collect(*frame);
+		std::swap(frame->arena, m_arena);
+		std::swap(frame->spans, m_spans);
+		std::swap(frame->inputs, m_pendingInputs);
+		std::swap(frame->jobs, m_jobs);
+		frame->statsEnabled = m_statsEnabled;
+
+		{
+			std::lock_guard lock(p.mutex);
+			p.queue.push_back(frame);
+		}
+		p.cv.notify_all();
+	}
+
+	// Takes what the render thread measured for a presented frame
+	void collect(Frame& frame) {
+		if (frame.statsEnabled && m_statsEnabled) m_stats.merge(frame.stats);
+		frame.stats.reset();
+		for (uint64_t us : frame.latencies) m_latency.record(us);
+		frame.latencies.clear();
+	}
+
+	void renderLoop() {
+		UI_PROFILE_THREAD("render");
+		Pipeline& p = *m_pipeline;
+		std::unique_lock lock(p.mutex);
+		for (;;) {
+			p.cv.wait(lock, [&]() { return !p.queue.empty() || p.sync || p.stop; });
+			if (!p.queue.empty()) {
+				Frame* frame = p.queue.front();
+				p.queue.erase(p.queue.begin());
+				lock.unlock();
+				renderFrame(*frame);
+				lock.lock();
+				p.free.push_back(frame);
+				p.cv.notify_all();
+			}
+			else if (p.sync) {
+				lock.unlock();
+				(*p.sync)();
+				lock.lock();
+				p.sync = nullptr;
+				p.cv.notify_all();
+			}
+			else return;
+		}
+	}
+
+	void renderFrame(Frame& frame) {
+		UI_PROFILE_SCOPE("Device::renderFrame");
+		runRenderJobs(frame.jobs);
+
+		FrameStats* stats = frame.statsEnabled ? &frame.stats : nullptr;
+		submit(frame.arena, frame.spans, stats);
+
+		uint64_t t0 = stats ? SDL_GetPerformanceCounter() : 0;
+		SDL_RenderPresent(m_renderer);
+		submitStatsEnd(stats, FrameStats::PhasePresent, t0);
+
+		uint64_t now = SDL_GetPerformanceCounter();
+		for (uint64_t origin : frame.inputs) frame.latencies.push_back(latencySince(origin, now));
+		frame.inputs.clear();
+		frame.arena.clear();
+		frame.spans.clear();
+	}
+
+	static bool fits16(int x, int y, int w, int h) {
+		auto fits = [](int v) { return v >= INT16_MIN && v <= INT16_MAX; };
+		return fits(x) && fits(y) && fits(w) && fits(h);
+	}
+
+	static int16_t clamp16(int v) {
+		return int16_t(std::clamp(v, int(INT16_MIN), int(INT16_MAX)));
+	}
+
+	template<typename R>
+	void pushRecord(const R& rec) {
+		if (!m_spanOpen) {
+			uint32_t at = uint32_t(m_arena.size());
+			m_spans.push_back(Span{ .order = m_currentOrder, .begin = at, .end = at });
+			m_spanOpen = true;
+			// Submission starts every span on the skin texture
+			m_recordPage = 0;
+			if (m_capture.active) m_captureAbsolute.push_back(m_orderStack.size() > m_capture.depth);
+		}
+		m_currentOrder++;
+
+		size_t at = m_arena.size();
+		m_arena.resize(at + sizeof(R));
+		std::memcpy(m_arena.data() + at, &rec, sizeof(R));
+		m_spans.back().end = uint32_t(m_arena.size());
+
+		if (m_statsEnabled && rec.type != CmdTexture) {
+			m_stats.commands[rec.type == CmdDrawWide || rec.type == CmdColumns ? CmdDraw : rec.type]++;
+		}
+	}
+
+	// Appends variable-sized data to the record just pushed
+	void pushPayload(const void* data, size_t size) {
+		size_t at = m_arena.size();
+		m_arena.resize(at + size);
+		std::memcpy(m_arena.data() + at, data, size);
+		m_spans.back().end = uint32_t(m_arena.size());
+	}
+
+	template<typename R>
+	static R readRecord(const uint8_t*& it) {
+		R rec;
+		std::memcpy(&rec, it, sizeof(R));
+		it += sizeof(R);
+		return rec;
+	}
+
+	const Rect* activeClip() const {
+		if (m_recordClips.empty() || m_recordClips.back().width == Unclipped.width) return nullptr;
+		return &m_recordClips.back();
+	}
+
+	Rect currentClip() const {
+		const Rect* clip = activeClip();
+		return clip ? *clip : Unclipped;
+	}
+
+	void pushDraw(int x, int y, int w, int h, int rx, int ry, int rw, int rh, uint8_t r, uint8_t g, uint8_t b, uint16_t page = 0) {
+		if (const Rect* clip = activeClip()) {
+			Rect dst(x, y, w, h);
+			if (!clip->overlaps(dst)) {
+				if (m_statsEnabled) m_stats.culled++;
+				return;
+			}
+
+			// Trim unscaled quads (glyphs, 1:1 tiles) to the visible part
+			if (w == rw && h == rh) {
+				Rect vis = dst.intersect(*clip);
+				rx += vis.x - x; ry += vis.y - y;
+				x = vis.x; y = vis.y;
+				w = rw = vis.width; h = rh = vis.height;
+			}
+		}
+
+		// A span opened by this draw starts on page 0
+		if (page != (m_spanOpen ? m_recordPage : 0)) {
+			pushRecord(TextureRecord{ .type = CmdTexture, .page = page });
+			m_recordPage = page;
+		}
+
+		if (fits16(x, y, w, h)) {
+			pushRecord(DrawRecord{
+				.type = CmdDraw, .r = r, .g = g, .b = b,
+				.x = int16_t(x), .y = int16_t(y), .w = int16_t(w), .h = int16_t(h),
+				.rx = int16_t(rx), .ry = int16_t(ry), .rw = int16_t(rw), .rh = int16_t(rh)
+			});
+		} else {
+			pushRecord(DrawWideRecord{
+				.type = CmdDrawWide, .r = r, .g = g, .b = b,
+				.x = x, .y = y, .w = w, .h = h,
+				.rx = int16_t(rx), .ry = int16_t(ry), .rw = int16_t(rw), .rh = int16_t(rh)
+			});
+		}
+	}
+
+	SDL_Rect tileSource(int index, int rx, int ry, int rw, int rh) const {
+		const int cellW = m_themeWidth / 16;
+		const int cellH = m_themeHeight / 16;
+
+		index &= 0xFF;
+
+		rx = rx > cellW ? cellW : rx;
+		rx = rx < 0 ? cellW+rx : rx;
+		ry = ry > cellH ? cellH : ry;
+		ry = ry < 0 ? cellH+ry : ry;
+		rw = rw < 0 ? cellW+rw : rw;
+		rh = rh < 0 ? cellH+rh : rh;
+		rw = std::clamp(rw, 0, cellW);
+		rh = std::clamp(rh, 0, cellH);
+
+		int sx = (int(index) % 16) * cellW;
+		int sy = (int(index) / 16) * cellH;
+
+		return SDL_Rect{ sx + rx, sy + ry, rw, rh };
+	}
+
+	/**
+	 * @brief  Calls fn(x, y, w, h, rx, ry, rw, rh) for each of the nine patch sections
+	 * @note   Source coordinates follow drawTileSection's conventions (negative = from the far edge)
+	 */
+	template<typename Fn>
+	void forEachPatchSection(int x, int y, int w, int h, Fn&& fn) const {
+		const int p = m_patchPadding;
+
+		// corners
+		fn(x, y, p, p,                    0,  0, p, p);
+		fn(x + w - p, y, p, p,           -p,  0, p, p);
+		fn(x, y + h - p, p, p,            0, -p, p, p);
+		fn(x + w - p, y + h - p, p, p,   -p, -p, p, p);
+
+		// beams
+		fn(x + p, y, w - p*2, p,           p,  0, -p*2, p);
+		fn(x + p, y + h - p, w - p*2, p,   p, -p, -p*2, p);
+		fn(x, y + p, p, h - p*2,           0,  p,  p,  -p*2);
+		fn(x + w - p, y + p, p, h - p*2,  -p,  p,  p,  -p*2);
+
+		//middle
+		fn(x + p, y + p, w - p*2, h - p*2,  p, p, -p*2, -p*2);
+	}
+
+	void submitCopy(SDL_Texture* texture, const SDL_Rect& src, const SDL_Rect& dst, uint8_t r, uint8_t g, uint8_t b) {
+		SDL_SetTextureColorMod(texture, r, g, b);
+		SDL_RenderCopy(m_renderer, texture, &src, &dst);
+	}
+
+	const GlyphPage* glyphPage(uint32_t index) {
+		if (index == 0) return &m_skin->base();
+		if (index == m_lastPageIndex && m_lastPage) return m_lastPage;
+
+		m_lastPageIndex = index;
+		m_lastPage = m_skin->page(index);
+		return m_lastPage;
+	}
+
+	SDL_Texture* pageTexture(uint32_t index) {
+		if (index == 0) return m_theme;
+		if (index >= AtlasPageBase) {
+			size_t atlas = index - AtlasPageBase;
+			return atlas < m_atlasTextures.size() && m_atlasTextures[atlas] ? m_atlasTextures[atlas] : m_theme;
+		}
+
+		auto it = m_pageTextures.find(index);
+		if (it == m_pageTextures.end()) {
+			const GlyphPage* page = m_skin->page(index);
+			SDL_Texture* tex = page ? SDL_CreateTextureFromSurface(m_renderer, page->surface) : nullptr;
+			it = m_pageTextures.emplace(index, tex).first;
+		}
+		return it->second ? it->second : m_theme;
+	}
+
+	// Unicode code points of the skin's cells 0x80-0xFF, which follow code page 437
+	static constexpr uint16_t Cp437High[128] = {
+		0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+		0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+		0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+		0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+		0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+		0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+		0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+		0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+	};
+
+	// Cell for each code point from 0x80 up to the last one in the table, or 0 when it has none
+	static constexpr uint32_t Cp437First = 0x80, Cp437End = 0x25A1;
+	static constexpr auto Cp437Cells = []() {
+		std::array<uint8_t, Cp437End - Cp437First> cells{};
+		for (int i = 0; i < 128; i++) cells[Cp437High[i] - Cp437First] = uint8_t(0x80 + i);
+		return cells;
+	}();
+
+	static std::optional<uint8_t> cp437Cell(uint32_t cp) {
+		if (cp < Cp437First || cp >= Cp437End || !Cp437Cells[cp - Cp437First]) return std::nullopt;
+		return Cp437Cells[cp - Cp437First];
+	}
+
+	Glyph glyph(uint32_t cp) {
+		// ASCII is the base page's own cells; the rest of it holds code page 437 symbols
+		const GlyphPage& base = m_skin->base();
+		if (cp < 0x80) return Glyph{ &base, 0, uint8_t(cp) };
+		if (cp >= 0x100) {
+			if (const GlyphPage* page = glyphPage(cp >> 8)) return Glyph{ page, uint16_t(cp >> 8), uint8_t(cp & 0xFF) };
+		}
+		if (auto cell = cp437Cell(cp)) return Glyph{ &base, 0, *cell };
+		return Glyph{ &base, 0, uint8_t('?') };
+	}
+
+	int drawGlyph(const Glyph& gl, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+		const GlyphPage& page = *gl.page;
+
+		int sx = (gl.cell % 16) * page.cellWidth;
+		int sy = (gl.cell / 16) * page.cellHeight;
+
+		int cx = x - page.offsetX[gl.cell];
+		int cy = y + page.offsetY[gl.cell];
+
+		pushDraw(cx, cy, page.cellWidth, page.cellHeight, sx, sy, page.cellWidth, page.cellHeight, r, g, b, gl.pageIndex);
+
+		return gl.advance()/*  + m_charSpacingX */;
+	}
+
+	void clearGlyphPages() {
+		for (auto& [index, tex] : m_pageTextures) {
+			if (tex) SDL_DestroyTexture(tex);
+		}
+		m_pageTextures.clear();
+		m_lastPage = nullptr;
+	}
+
+	/**
+	 * @brief  Sorts and executes a frame's commands
+	 * @note   Runs on the render thread when pipelined
+	 * @param  stats: Statistics to accumulate into, or nullptr
+	 * @retval None
+	 */
+	void submit(std::vector<uint8_t>& arena, std::vector<Span>& spans, FrameStats* stats) {
+		m_submitStats = stats;
+		SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
+		SDL_RenderClear(m_renderer);
+
+		uint64_t t0 = stats ? SDL_GetPerformanceCounter() : 0;
+		std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+			return a.order != b.order ? a.order < b.order : a.begin < b.begin;
+		});
+		submitStatsEnd(stats, FrameStats::PhaseSort, t0);
+
+		t0 = stats ? SDL_GetPerformanceCounter() : 0;
+		int drawCalls = 0;
+		for (const Span& span : spans) {
+			m_submitTexture = m_theme;
+			const uint8_t* it = arena.data() + span.begin;
+			const uint8_t* end = arena.data() + span.end;
+			while (it < end) {
+				switch (CommandType(*it)) {
+					case CmdDraw: {
+						auto rec = readRecord<DrawRecord>(it);
+						SDL_Rect src = { rec.rx, rec.ry, rec.rw, rec.rh };
+						SDL_Rect dst = { rec.x, rec.y, rec.w, rec.h };
+						submitCopy(m_submitTexture, src, dst, rec.r, rec.g, rec.b);
+						drawCalls++;
+					} break;
+					case CmdDrawWide: {
+						auto rec = readRecord<DrawWideRecord>(it);
+						SDL_Rect src = { rec.rx, rec.ry, rec.rw, rec.rh };
+						SDL_Rect dst = { rec.x, rec.y, rec.w, rec.h };
+						submitCopy(m_submitTexture, src, dst, rec.r, rec.g, rec.b);
+						drawCalls++;
+					} break;
+					case CmdPatch: {
+						auto rec = readRecord<PatchRecord>(it);
+						if (submitCachedPatch(rec)) {
+							drawCalls++;
+							break;
+						}
+						forEachPatchSection(rec.x, rec.y, rec.w, rec.h, [&](int sx, int sy, int sw, int sh, int rx, int ry, int rw, int rh) {
+							SDL_Rect src = tileSource(rec.index, rx, ry, rw, rh);
+							SDL_Rect dst = { sx, sy, sw, sh };
+							submitCopy(m_theme, src, dst, rec.r, rec.g, rec.b);
+							drawCalls++;
+						});
+					} break;
+					case CmdColumns: {
+						auto rec = readRecord<ColumnsRecord>(it);
+						m_columnRects.clear();
+						for (int i = 0; i < rec.count; i++, it += 2 * sizeof(int16_t)) {
+							int16_t span[2];
+							std::memcpy(span, it, sizeof(span));
+							SDL_Rect col = { rec.x + i, rec.y + span[0], 1, span[1] - span[0] + 1 };
+							if (col.h <= 0) continue;
+
+							SDL_Rect* last = m_columnRects.empty() ? nullptr : &m_columnRects.back();
+							if (last && last->x + last->w == col.x && last->y == col.y && last->h == col.h) last->w++;
+							else m_columnRects.push_back(col);
+						}
+						SDL_SetRenderDrawColor(m_renderer, rec.r, rec.g, rec.b, 255);
+						SDL_RenderFillRects(m_renderer, m_columnRects.data(), int(m_columnRects.size()));
+						drawCalls++;
+					} break;
+					case CmdTexture: {
+						auto rec = readRecord<TextureRecord>(it);
+						m_submitTexture = pageTexture(rec.page);
+					} break;
+					case CmdClip: {
+						auto rec = readRecord<RectRecord>(it);
+						clipPush(rec.x, rec.y, rec.w, rec.h);
+					} break;
+					case CmdUnClip: {
+						readRecord<UnClipRecord>(it);
+						clipPop();
+					} break;
+					case CmdDebug: {
+						auto rec = readRecord<RectRecord>(it);
+						SDL_Rect r = { rec.x, rec.y, rec.w, rec.h };
+						SDL_SetRenderDrawColor(m_renderer, 0, 255, 100, 255);
+						SDL_RenderDrawRect(m_renderer, &r);
+						drawCalls++;
+					} break;
+					default: it = end; break;
+				}
+			}
+		}
+		submitStatsEnd(stats, FrameStats::PhaseFlush, t0);
+		if (stats) {
+			stats->drawCalls += drawCalls;
+			stats->commandBytes += int(arena.size());
+		}
+		m_submitStats = nullptr;
+	}
+
+	void submitStatsEnd(FrameStats* stats, FrameStats::Phase phase, uint64_t start) const {
+		if (stats) stats->phases[phase] += double(SDL_GetPerformanceCounter() - start) / m_statsFrequency;
+	}
+
+	/**
+	 * @brief  Draws a nine-patch record from the patch cache, compositing it on a miss
+	 * @retval false if the patch can't be cached and must be drawn section by section
+	 */
+	bool submitCachedPatch(const PatchRecord& rec) {
+		const size_t bytes = size_t(rec.w) * size_t(rec.h) * 4;
+		if (rec.w <= m_patchPadding * 2 || rec.h <= m_patchPadding * 2 || bytes > m_patchCacheBudget) return false;
+
+		const uint64_t key =
+			uint64_t(rec.index) |
+			uint64_t(uint16_t(rec.w)) << 8 |
+			uint64_t(uint16_t(rec.h)) << 24 |
+			uint64_t(rec.r) << 40 | uint64_t(rec.g) << 48 | uint64_t(rec.b) << 56;
+
+		SDL_Texture* tex = nullptr;
+		auto found = m_patchCacheIndex.find(key);
+		if (found != m_patchCacheIndex.end()) {
+			m_patchCache.splice(m_patchCache.begin(), m_patchCache, found->second);
+			tex = found->second->texture;
+			if (m_submitStats) m_submitStats->patchCacheHits++;
+		} else {
+			if (!SDL_RenderTargetSupported(m_renderer)) return false;
+
+			tex = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, rec.w, rec.h);
+			if (!tex) return false;
+
+			SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+			SDL_SetRenderTarget(m_renderer, tex);
+			SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
+			SDL_RenderClear(m_renderer);
+			forEachPatchSection(0, 0, rec.w, rec.h, [&](int sx, int sy, int sw, int sh, int rx, int ry, int rw, int rh) {
+				SDL_Rect src = tileSource(rec.index, rx, ry, rw, rh);
+				SDL_Rect dst = { sx, sy, sw, sh };
+				submitCopy(m_theme, src, dst, rec.r, rec.g, rec.b);
+			});
+			SDL_SetRenderTarget(m_renderer, nullptr);
+			restoreClip();
+
+			trimPatchCache(bytes);
+			m_patchCache.push_front(PatchCacheEntry{ .key = key, .texture = tex, .bytes = bytes });
+			m_patchCacheIndex[key] = m_patchCache.begin();
+			m_patchCacheBytes += bytes;
+			if (m_submitStats) m_submitStats->patchCacheMisses++;
+		}
+
+		SDL_Rect dst = { rec.x, rec.y, rec.w, rec.h };
+		SDL_RenderCopy(m_renderer, tex, nullptr, &dst);
+		return true;
+	}
+
+	/**
+	 * @brief  Evicts least recently used patches until `incoming` more bytes fit the budget
+	 */
+	void trimPatchCache(size_t incoming) {
+		while (!m_patchCache.empty() && m_patchCacheBytes + incoming > m_patchCacheBudget) {
+			auto& last = m_patchCache.back();
+			SDL_DestroyTexture(last.texture);
+			m_patchCacheBytes -= last.bytes;
+			m_patchCacheIndex.erase(last.key);
+			m_patchCache.pop_back();
+		}
+	}
+
+	void clearPatchCache() {
+		for (auto& entry : m_patchCache) SDL_DestroyTexture(entry.texture);
+		m_patchCache.clear();
+		m_patchCacheIndex.clear();
+		m_patchCacheBytes = 0;
+	}
+	
+	void clipPush(int x, int y, int w, int h) {
+		SDL_Rect rec = { x, y, w, h };
+		SDL_RenderSetClipRect(m_renderer, &rec);
+		m_clips.push(Rect(x, y, w, h));
+	}
+
+	void clipPop() {
+		if (!m_clips.empty()) m_clips.pop();
+		restoreClip();
+	}
+
+	void restoreClip() {
+		if (!m_clips.empty()) {
+			Rect b = m_clips.top();
+			SDL_Rect rec = { b.x, b.y, b.width, b.height };
+			SDL_RenderSetClipRect(m_renderer, &rec);
+		} else {
+			SDL_RenderSetClipRect(m_renderer, nullptr);
+		}
+	}
+
+};
+
+enum Alignment {
+	Near = 0,
+	Center,
+	Far
+};
+
+struct MouseEvent {
+	enum {
+		MouseEventDown,
+		MouseEventUp,
+		MouseEventMove,
+		MouseEventWheel
+	} type{ MouseEventMove };
+	int x{ 0 }, y{ 0 }, button{ 0 };
+	int wheelX{ 0 }, wheelY{ 0 };
+};
+
+struct KeyboardEvent {
+	enum {
+		KeyEventDown,
+		KeyEventType,
+		KeyEventCommand
+	} type{ KeyEventDown };
+	uint32_t key{ 0 };
+	char input{ 0 };
+};
+
+struct Context {
+	Rect bounds{};
+};
+
+using WID = uint32_t;
+
+struct Text {
+	std::string text{};
+	Alignment align{ Alignment::Near };
+	Color color{ .r = 255, .g = 255, .b = 255 };
+};
+
+enum ButtonState {
+	ButtonStateNormal = 0,
+	ButtonStateHover,
+	ButtonStatePressed
+};
+
+struct Button {
+	std::string text{};
+	std::function<void()> onPressed;
+	bool disabled{ false };
+
+	ButtonState state{ ButtonStateNormal };
+};
+
+struct Root {
+	WID child;
+};
 
 struct Container {
 	int width{ 0 }, height{ 0 };
@@ -418,69 +2666,556 @@ struct Container {
 	bool background{ false };
 };
 
-struct Layout {
-	WID top, bottom, left, right, center;
+struct Layout {
+	WID top, bottom, left, right, center;
+};
+
+struct Column {
+	std::vector<WID> children;
+	Alignment alignment{ Alignment::Center };
+	int spacing{ 3 };
+};
+
+struct Placement {
+	float x{ 0.0f }, y{ 0.0f };
+	WID child;
+};
+
+struct Slider {
+	float min{ 0.0f }, max{ 100.0f };
+	float value{ 0.0f };
+	float step{ 1.0f }; // 0 for a continuous value
+	bool disabled{ false };
+	std::string param; // id in the UISystem's ParameterStore
+	std::function<void(float)> onChange;
+
+	ButtonState __state{ ButtonState::ButtonStateNormal };
+};
+
+struct Input {
+	std::string text{};
+	std::string pattern{ ".*" };
+	bool masked{ false }, disabled{ false };
+
+	int __cursor{ 0 }, __viewx{ 0 };
+	double __blinkStart{ 0.0 };
+};
+
+struct ScrollView {
+	int width{ 0 }, height{ 0 };
+	WID child;
+	int scrollX{ 0 }, scrollY{ 0 };
+	bool horizontal{ false }, vertical{ true };
+	int step{ 16 };
+
+	int __contentWidth{ 0 }, __contentHeight{ 0 };
+};
+
+struct Meter {
+	int width{ 0 }, height{ 0 };
+	bool vertical{ true };
+	float decay{ 1.5f }; // level falloff per second
+	SampleRing* source{ nullptr };
+
+	float __level{ 0.0f };
+	double __lastTime{ 0.0 };
+	std::vector<int16_t> __spans;
+};
+
+struct Scope {
+	int width{ 0 }, height{ 0 };
+	int samples{ 2048 }; // history shown across the width
+	Color color{ .r = 80, .g = 255, .b = 120 };
+	SampleRing* source{ nullptr };
+
+	std::vector<float> __history;
+	size_t __write{ 0 };
+	std::vector<int16_t> __spans;
+};
+
+struct Image {
+	std::string source{}; // BMP path
+	int width{ 0 }, height{ 0 }; // 0 uses the image's size
+	Color tint{ .r = 255, .g = 255, .b = 255 };
+};
+
+struct Plot {
+	int width{ 0 }, height{ 0 };
+	float min{ 0.0f }, max{ 0.0f }; // both 0 fits the data
+	bool fill{ false }; // fills down to zero, e.g. for spectra
+	Color color{ .r = 80, .g = 200, .b = 255 };
+	std::shared_ptr<const PlotData> data;
+
+	double __begin{ 0.0 }, __end{ 0.0 }; // visible samples
+	int __dragX{ 0 };
+	bool __dragging{ false };
+	std::vector<int16_t> __spans;
+};
+
+// --------------- REGISTRY
+
+template<typename... Ts>
+struct TypeList {
+	static constexpr size_t size = sizeof...(Ts);
+
+	template<template<typename...> class C>
+	using apply = C<Ts...>;
+};
+
+template<typename W, typename T, bool Child = false>
+struct Property {
+	std::string_view name;
+	T W::* member;
+
+	// Holds child widget ids, parsed as nested widget declarations rather than numbers
+	static constexpr bool child = Child;
+};
+
+template<typename W, typename T>
+constexpr Property<W, T> prop(std::string_view name, T W::* member) {
+	return Property<W, T>{ name, member };
+}
+
+template<typename W, typename T>
+constexpr Property<W, T, true> childProp(std::string_view name, T W::* member) {
+	return Property<W, T, true>{ name, member };
+}
+
+/**
+ * Compile-time perfect hash over a fixed set of names.
+ * The seed is searched at compile time so every name lands in its own slot;
+ * find() hashes once and confirms with a single comparison.
+ */
+template<size_t N>
+struct NameTable {
+	static constexpr size_t Slots = std::bit_ceil(N * 4 + 1);
+
+	std::array<std::string_view, N> names{};
+	std::array<uint8_t, Slots> slots{};
+	uint32_t seed{ 0 };
+
+	static constexpr uint32_t hash(std::string_view str, uint32_t seed) {
+		uint32_t h = 2166136261u ^ seed;
+		for (char c : str) {
+			h ^= uint8_t(c);
+			h *= 16777619u;
+		}
+		return h ^ (h >> 15);
+	}
+
+	constexpr NameTable(const std::array<std::string_view, N>& names) : names(names) {
+		for (seed = 1; ; seed++) {
+			slots = {};
+			bool ok = true;
+			for (size_t i = 0; i < N && ok; i++) {
+				uint8_t& slot = slots[hash(names[i], seed) & (Slots - 1)];
+				ok = slot == 0;
+				slot = uint8_t(i + 1);
+			}
+			if (ok) break;
+		}
+	}
+
+	constexpr int find(std::string_view str) const {
+		uint8_t slot = slots[hash(str, seed) & (Slots - 1)];
+		if (slot == 0 || names[slot - 1] != str) return -1;
+		return slot - 1;
+	}
+};
+
+/**
+ * Describes a widget type to the registry: its class name in .ui files and its parsed properties.
+ * Specialize next to each widget struct and add the type to WidgetTypes.
+ */
+template<typename W>
+struct WidgetInfo;
+
+template<> struct WidgetInfo<Root> {
+	static constexpr std::string_view name = "Root";
+	static constexpr auto properties = std::make_tuple(
+		childProp("child", &Root::child)
+	);
+};
+
+template<> struct WidgetInfo<Container> {
+	static constexpr std::string_view name = "Container";
+	static constexpr auto properties = std::make_tuple(
+		childProp("child", &Container::child),
+		prop("width", &Container::width),
+		prop("height", &Container::height),
+		prop("background", &Container::background)
+	);
+};
+
+template<> struct WidgetInfo<Layout> {
+	static constexpr std::string_view name = "Layout";
+	static constexpr auto properties = std::make_tuple(
+		childProp("center", &Layout::center),
+		childProp("left", &Layout::left),
+		childProp("right", &Layout::right),
+		childProp("top", &Layout::top),
+		childProp("bottom", &Layout::bottom)
+	);
+};
+
+template<> struct WidgetInfo<Column> {
+	static constexpr std::string_view name = "Column";
+	static constexpr auto properties = std::make_tuple(
+		childProp("children", &Column::children),
+		prop("alignment", &Column::alignment),
+		prop("spacing", &Column::spacing)
+	);
+};
+
+template<> struct WidgetInfo<Placement> {
+	static constexpr std::string_view name = "Placement";
+	static constexpr auto properties = std::make_tuple(
+		childProp("child", &Placement::child),
+		prop("x", &Placement::x),
+		prop("y", &Placement::y)
+	);
+};
+
+template<> struct WidgetInfo<Text> {
+	static constexpr std::string_view name = "Text";
+	static constexpr auto properties = std::make_tuple(
+		prop("text", &Text::text),
+		prop("color", &Text::color),
+		prop("align", &Text::align)
+	);
+
+	// Leaf widget: its commands are replayed from a display list while it's unchanged
+	static constexpr bool cached = true;
 };
 
-struct Column {
-	std::vector<WID> children;
-	Alignment alignment{ Alignment::Center };
-	int spacing{ 3 };
+template<> struct WidgetInfo<Button> {
+	static constexpr std::string_view name = "Button";
+	static constexpr auto properties = std::make_tuple(
+		prop("text", &Button::text),
+		prop("disabled", &Button::disabled)
+	);
+
+	static constexpr bool cached = true;
 };
 
-struct Placement {
-	float x{ 0.0f }, y{ 0.0f };
-	WID child;
+template<> struct WidgetInfo<Slider> {
+	static constexpr std::string_view name = "Slider";
+	static constexpr auto properties = std::make_tuple(
+		prop("min", &Slider::min),
+		prop("max", &Slider::max),
+		prop("value", &Slider::value),
+		prop("step", &Slider::step),
+		prop("disabled", &Slider::disabled),
+		prop("param", &Slider::param)
+	);
+
+	static constexpr bool cached = true;
 };
 
-struct Slider {
-	int min{ 0 }, max{ 100 };
-	int value{ 0 };
-	bool disabled{ false };
-	std::function<void(int)> onChange;
+template<> struct WidgetInfo<Input> {
+	static constexpr std::string_view name = "Input";
+	static constexpr auto properties = std::make_tuple(
+		prop("text", &Input::text),
+		prop("pattern", &Input::pattern),
+		prop("masked", &Input::masked),
+		prop("disabled", &Input::disabled)
+	);
 
-	ButtonState __state{ ButtonState::ButtonStateNormal };
+	static constexpr bool cached = true;
+
+	// Runtime state kept by snapshots, not settable from .ui files
+	static constexpr auto state = std::make_tuple(
+		prop("__cursor", &Input::__cursor),
+		prop("__viewx", &Input::__viewx)
+	);
 };
 
-struct Input {
-	std::string text{};
-	std::string pattern{ ".*" };
-	bool masked{ false }, disabled{ false };
+template<> struct WidgetInfo<ScrollView> {
+	static constexpr std::string_view name = "ScrollView";
+	static constexpr auto properties = std::make_tuple(
+		childProp("child", &ScrollView::child),
+		prop("width", &ScrollView::width),
+		prop("height", &ScrollView::height),
+		prop("scrollX", &ScrollView::scrollX),
+		prop("scrollY", &ScrollView::scrollY),
+		prop("horizontal", &ScrollView::horizontal),
+		prop("vertical", &ScrollView::vertical),
+		prop("step", &ScrollView::step)
+	);
+};
 
-	int __cursor{ 0 }, __viewx{ 0 };
+template<> struct WidgetInfo<Meter> {
+	static constexpr std::string_view name = "Meter";
+	static constexpr auto properties = std::make_tuple(
+		prop("width", &Meter::width),
+		prop("height", &Meter::height),
+		prop("vertical", &Meter::vertical),
+		prop("decay", &Meter::decay)
+	);
+};
+
+template<> struct WidgetInfo<Scope> {
+	static constexpr std::string_view name = "Scope";
+	static constexpr auto properties = std::make_tuple(
+		prop("width", &Scope::width),
+		prop("height", &Scope::height),
+		prop("samples", &Scope::samples),
+		prop("color", &Scope::color)
+	);
 };
 
-using Widget = std::variant<
+template<> struct WidgetInfo<Image> {
+	static constexpr std::string_view name = "Image";
+	static constexpr auto properties = std::make_tuple(
+		prop("source", &Image::source),
+		prop("width", &Image::width),
+		prop("height", &Image::height),
+		prop("tint", &Image::tint)
+	);
+
+	static constexpr bool cached = true;
+};
+
+template<> struct WidgetInfo<Plot> {
+	static constexpr std::string_view name = "Plot";
+	static constexpr auto properties = std::make_tuple(
+		prop("width", &Plot::width),
+		prop("height", &Plot::height),
+		prop("min", &Plot::min),
+		prop("max", &Plot::max),
+		prop("fill", &Plot::fill),
+		prop("color", &Plot::color)
+	);
+
+	static constexpr bool cached = true;
+};
+
+using WidgetTypes = TypeList<
 	Root, Container, Layout, Column, Placement,
-	Text, Button, Slider, Input
+	Text, Button, Slider, Input, ScrollView,
+	Meter, Scope, Image, Plot
 >;
 
-#define STR(x) #x
-#define XSTR(x) STR(x)
+using Widget = WidgetTypes::apply<std::variant>;
 
-#define UI_DECLARE_WIDGET(T) \
-	template<> \
-	void draw<T>(Device& dev, WID wid, T& w, const Context& ctx, UISystem* sys); \
-	template<> \
-	Rect bounds<T>(Device& dev, WID wid, T& w, const Context& ctx, UISystem* sys); \
-	template<> \
-	bool onMouseEvent<T>(Device& dev, const MouseEvent& e, WID wid, T& w, const Context& ctx, UISystem* sys); \
-	template<> \
-	void onKeyEvent<T>(Device& dev, const KeyboardEvent& e, WID wid, T& w, UISystem* sys) {} \
-	template<> \
-	std::string className<T>() { return XSTR(T); }
+/**
+ * Value of a bindable property. Properties of other types (colors, children...)
+ * can't be bound.
+ */
+using PropertyValue = std::variant<int, float, bool, std::string>;
 
-#define UI_DECLARE_WIDGET_KB(T) \
-	template<> \
-	void draw<T>(Device& dev, WID wid, T& w, const Context& ctx, UISystem* sys); \
-	template<> \
-	Rect bounds<T>(Device& dev, WID wid, T& w, const Context& ctx, UISystem* sys); \
-	template<> \
-	bool onMouseEvent<T>(Device& dev, const MouseEvent& e, WID wid, T& w, const Context& ctx, UISystem* sys); \
-	template<> \
-	void onKeyEvent<T>(Device& dev, const KeyboardEvent& e, WID wid, T& w, UISystem* sys); \
-	template<> \
-	std::string className<T>() { return XSTR(T); }
+namespace internal {
+
+	template<typename W>
+	constexpr auto propertyNames() {
+		return std::apply([](const auto&... p) {
+			return std::array<std::string_view, sizeof...(p)>{ p.name... };
+		}, WidgetInfo<W>::properties);
+	}
+
+	template<typename W>
+	inline constexpr NameTable<std::tuple_size_v<decltype(WidgetInfo<W>::properties)>> propertyTable{ propertyNames<W>() };
+
+	template<typename... Ts>
+	constexpr auto classNames(TypeList<Ts...>) {
+		return std::array<std::string_view, sizeof...(Ts)>{ WidgetInfo<Ts>::name... };
+	}
+
+	inline constexpr NameTable<WidgetTypes::size> classTable{ classNames(WidgetTypes{}) };
+
+	template<typename W>
+	constexpr std::string_view className() { return WidgetInfo<W>::name; }
+
+	template<typename T>
+	std::optional<PropertyValue> toPropertyValue(const T& v) {
+		if constexpr (std::is_constructible_v<PropertyValue, T>) return PropertyValue(v);
+		else return std::nullopt;
+	}
+
+	/**
+	 * @brief  Converts and assigns a property value
+	 * @retval true if the destination changed
+	 */
+	template<typename T>
+	bool fromPropertyValue(const PropertyValue& v, T& out) {
+		constexpr bool number = std::is_same_v<T, int> || std::is_same_v<T, float>;
+		if constexpr (!std::is_same_v<T, std::string> && !std::is_same_v<T, bool> && !number) {
+			return false;
+		} else {
+			T value{};
+			if constexpr (std::is_same_v<T, std::string>) {
+				char buf[32];
+				if (auto i = std::get_if<int>(&v)) value.assign(buf, std::snprintf(buf, sizeof(buf), "%d", *i));
+				else if (auto f = std::get_if<float>(&v)) value.assign(buf, std::snprintf(buf, sizeof(buf), "%g", *f));
+				else if (auto b = std::get_if<bool>(&v)) value = *b ? "true" : "false";
+				else value = std::get<std::string>(v);
+			} else if constexpr (std::is_same_v<T, bool>) {
+				if (auto s = std::get_if<std::string>(&v)) value = *s == "true" || *s == "1";
+				else if (auto i = std::get_if<int>(&v)) value = *i != 0;
+				else if (auto f = std::get_if<float>(&v)) value = *f != 0.0f;
+				else value = std::get<bool>(v);
+			} else {
+				if (auto s = std::get_if<std::string>(&v)) {
+					if (std::from_chars(s->data(), s->data() + s->size(), value).ec != std::errc{}) return false;
+				} else if (auto f = std::get_if<float>(&v)) {
+					value = std::is_same_v<T, int> ? T(std::lround(*f)) : T(*f);
+				} else if (auto i = std::get_if<int>(&v)) {
+					value = T(*i);
+				} else {
+					value = T(std::get<bool>(v));
+				}
+			}
+
+			if (value == out) return false;
+			out = std::move(value);
+			return true;
+		}
+	}
+
+	template<typename W>
+	std::optional<PropertyValue> getProperty(const W& w, int index) {
+		using Getter = std::optional<PropertyValue> (*)(const W&);
+		static constexpr auto getters = []<size_t... I>(std::index_sequence<I...>) {
+			return std::array<Getter, sizeof...(I)>{
+				[](const W& w) -> std::optional<PropertyValue> {
+					constexpr auto property = std::get<I>(WidgetInfo<W>::properties);
+					if constexpr (property.child) return std::nullopt;
+					else return toPropertyValue(w.*(property.member));
+				}...
+			};
+		}(std::make_index_sequence<std::tuple_size_v<decltype(WidgetInfo<W>::properties)>>{});
+
+		if (index < 0 || index >= int(getters.size())) return std::nullopt;
+		return getters[index](w);
+	}
+
+	template<typename W>
+	bool setProperty(W& w, int index, const PropertyValue& v) {
+		using Setter = bool (*)(W&, const PropertyValue&);
+		static constexpr auto setters = []<size_t... I>(std::index_sequence<I...>) {
+			return std::array<Setter, sizeof...(I)>{
+				[](W& w, const PropertyValue& v) {
+					constexpr auto property = std::get<I>(WidgetInfo<W>::properties);
+					if constexpr (property.child) return false;
+					else return fromPropertyValue(v, w.*(property.member));
+				}...
+			};
+		}(std::make_index_sequence<std::tuple_size_v<decltype(WidgetInfo<W>::properties)>>{});
+
+		if (index < 0 || index >= int(setters.size())) return false;
+		return setters[index](w, v);
+	}
+
+	// LEB128 varints, shared by the binary formats (traces, snapshots)
+	inline void writeVarint(std::vector<uint8_t>& out, uint64_t v) {
+		do {
+			uint8_t byte = v & 0x7F;
+			v >>= 7;
+			out.push_back(byte | (v ? 0x80 : 0));
+		} while (v);
+	}
+
+	inline void writeZigzag(std::vector<uint8_t>& out, int64_t v) {
+		writeVarint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+	}
+
+	inline uint64_t readVarint(const std::vector<uint8_t>& in, size_t& pos) {
+		uint64_t v = 0;
+		for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+			uint8_t byte = in[pos++];
+			v |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) break;
+		}
+		return v;
+	}
+
+	inline int64_t readZigzag(const std::vector<uint8_t>& in, size_t& pos) {
+		uint64_t v = readVarint(in, pos);
+		return int64_t(v >> 1) ^ -int64_t(v & 1);
+	}
+
+	inline void writeBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+		out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+	}
+
+	inline bool readBytes(const std::vector<uint8_t>& in, size_t& pos, void* data, size_t size) {
+		if (pos + size > in.size()) {
+			pos = in.size();
+			return false;
+		}
+		std::memcpy(data, in.data() + pos, size);
+		pos += size;
+		return true;
+	}
+
+	// Field encodings for every property type
+	inline void writeField(std::vector<uint8_t>& out, int v) { writeZigzag(out, v); }
+	inline void writeField(std::vector<uint8_t>& out, WID v) { writeVarint(out, v); }
+	inline void writeField(std::vector<uint8_t>& out, bool v) { out.push_back(v); }
+	inline void writeField(std::vector<uint8_t>& out, float v) { writeBytes(out, &v, sizeof(v)); }
+	inline void writeField(std::vector<uint8_t>& out, Alignment v) { writeVarint(out, uint64_t(v)); }
+	inline void writeField(std::vector<uint8_t>& out, const Color& v) { writeBytes(out, &v, 3); }
+	inline void writeField(std::vector<uint8_t>& out, const std::string& v) {
+		writeVarint(out, v.size());
+		writeBytes(out, v.data(), v.size());
+	}
+	inline void writeField(std::vector<uint8_t>& out, const std::vector<WID>& v) {
+		writeVarint(out, v.size());
+		for (WID id : v) writeVarint(out, id);
+	}
+
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, int& v) { v = int(readZigzag(in, pos)); }
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, WID& v) { v = WID(readVarint(in, pos)); }
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, bool& v) { v = pos < in.size() && in[pos++]; }
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, float& v) { readBytes(in, pos, &v, sizeof(v)); }
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, Alignment& v) { v = Alignment(readVarint(in, pos)); }
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, Color& v) { readBytes(in, pos, &v, 3); }
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, std::string& v) {
+		size_t size = std::min<size_t>(readVarint(in, pos), in.size() - pos);
+		v.assign((const char*)in.data() + pos, size);
+		pos += size;
+	}
+	inline void readField(const std::vector<uint8_t>& in, size_t& pos, std::vector<WID>& v) {
+		size_t size = std::min<size_t>(readVarint(in, pos), in.size() - pos);
+		v.resize(size);
+		for (WID& id : v) id = WID(readVarint(in, pos));
+	}
+
+	template<typename W>
+	constexpr bool cachedOf() {
+		if constexpr (requires { WidgetInfo<W>::cached; }) return WidgetInfo<W>::cached;
+		else return false;
+	}
+
+	template<typename W>
+	constexpr auto stateOf() {
+		if constexpr (requires { WidgetInfo<W>::state; }) return WidgetInfo<W>::state;
+		else return std::tuple<>{};
+	}
+
+	/**
+	 * @brief  Calls fn(index, name, field) for every property, then every runtime state field
+	 * @note   Property indices match propertyTable<W>; state fields continue after them
+	 */
+	template<typename W, typename Fn>
+	void forEachField(W& w, Fn&& fn) {
+		constexpr auto fields = std::tuple_cat(WidgetInfo<std::remove_const_t<W>>::properties, stateOf<std::remove_const_t<W>>());
+		[&]<size_t... I>(std::index_sequence<I...>) {
+			(fn(int(I), std::get<I>(fields).name, w.*(std::get<I>(fields).member)), ...);
+		}(std::make_index_sequence<std::tuple_size_v<decltype(fields)>>{});
+	}
+
+	/**
+	 * @brief  Calls fn(std::type_identity<W>{}) for the widget type at a variant index
+	 * @retval false if the index is out of range
+	 */
+	template<typename Fn, typename... Ts>
+	bool visitType(size_t index, Fn&& fn, TypeList<Ts...>) {
+		size_t i = 0;
+		return ((i++ == index ? (fn(std::type_identity<Ts>{}), true) : false) || ...);
+	}
+
+}
 
 #define UI_WIDGET_DRAW_IMPL(T) \
 	template<> \
@@ -498,9 +3233,532 @@ using Widget = std::variant<
 	template<> \
 	void internal::onKeyEvent<T>(Device& dev, const KeyboardEvent& e, WID wid, T& w, UISystem* sys)
 
+/**
+ * Animation of a numeric property towards a target value
+ */
+struct Tween {
+	enum Easing {
+		Linear = 0,
+		EaseIn,
+		EaseOut,
+		EaseInOut
+	};
+
+	enum Repeat {
+		Once = 0,
+		Loop,
+		PingPong
+	};
+
+	uint64_t key; // animated property, see UISystem::propertyKey
+	float from, to;
+	double start, duration;
+	Easing easing;
+	Repeat repeat;
+
+	static float ease(Easing easing, float t) {
+		switch (easing) {
+			default: return t;
+			case EaseIn: return t * t * t;
+			case EaseOut: { float u = 1.0f - t; return 1.0f - u * u * u; }
+			case EaseInOut: {
+				if (t < 0.5f) return 4.0f * t * t * t;
+				float u = -2.0f * t + 2.0f;
+				return 1.0f - u * u * u / 2.0f;
+			}
+		}
+	}
+
+	/**
+	 * @brief  Computes the value at a given time
+	 * @param  now: Time in seconds
+	 * @param  done: Set when the tween has reached its end
+	 * @retval The interpolated value
+	 */
+	float sample(double now, bool& done) const {
+		double t = duration > 0.0 ? (now - start) / duration : 1.0;
+		done = repeat == Once && t >= 1.0;
+		if (repeat == Once) t = std::min(t, 1.0);
+		else if (repeat == Loop) t = t - std::floor(t);
+		else {
+			t = std::fmod(t, 2.0);
+			if (t > 1.0) t = 2.0 - t;
+		}
+		return from + (to - from) * ease(easing, float(std::max(t, 0.0)));
+	}
+};
+
+/**
+ * Compact recording of the events passed to UISystem::processEvents,
+ * with frame boundaries, for deterministic replays.
+ *
+ * Layout: "UITR", version byte, then records of a tag byte, the time since
+ * the previous record in microseconds and tag-specific fields, all as LEB128
+ * varints (signed fields zigzag encoded).
+ */
+class InputTrace {
+public:
+	enum Tag : uint8_t {
+		TagFrame = 0,
+		TagButtonDown,
+		TagButtonUp,
+		TagMotion,
+		TagWheel,
+		TagKeyDown,
+		TagText
+	};
+
+	/**
+	 * @brief  Appends an event
+	 * @note   Events UISystem doesn't handle are ignored
+	 * @param  e: Event
+	 * @param  time: Monotonic time in seconds
+	 * @retval None
+	 */
+	void record(const SDL_Event& e, double time) {
+		switch (e.type) {
+			default: return;
+			case SDL_MOUSEBUTTONDOWN:
+			case SDL_MOUSEBUTTONUP:
+				header(e.type == SDL_MOUSEBUTTONDOWN ? TagButtonDown : TagButtonUp, time);
+				writeSigned(e.button.x); writeSigned(e.button.y);
+				write(e.button.button);
+				break;
+			case SDL_MOUSEMOTION:
+				header(TagMotion, time);
+				writeSigned(e.motion.x); writeSigned(e.motion.y);
+				break;
+			case SDL_MOUSEWHEEL:
+				header(TagWheel, time);
+				writeSigned(e.wheel.x); writeSigned(e.wheel.y);
+				write(e.wheel.direction);
+				break;
+			case SDL_KEYDOWN:
+				header(TagKeyDown, time);
+				write(uint32_t(e.key.keysym.sym));
+				write(SDL_GetModState());
+				break;
+			case SDL_TEXTINPUT: {
+				header(TagText, time);
+				write(SDL_GetModState());
+				size_t length = std::strlen(e.text.text);
+				write(length);
+				m_data.insert(m_data.end(), e.text.text, e.text.text + length);
+			} break;
+		}
+		m_events++;
+	}
+
+	/**
+	 * @brief  Marks the start of a frame
+	 * @param  time: Monotonic time in seconds
+	 * @retval None
+	 */
+	void frame(double time) {
+		header(TagFrame, time);
+	}
+
+	/**
+	 * @brief  Reads the next record
+	 * @param  e: Receives the event, unless the record is a frame mark
+	 * @param  time: Receives the record time, in seconds since the trace started
+	 * @retval TagFrame or the event's tag, nullopt at the end of the trace
+	 */
+	std::optional<Tag> next(SDL_Event& e, double& time) {
+		if (m_read >= m_data.size()) return std::nullopt;
+
+		Tag tag = Tag(m_data[m_read++]);
+		m_readTime += read();
+		time = double(m_readTime) / 1e6;
+
+		e = SDL_Event{};
+		switch (tag) {
+			case TagFrame: break;
+			case TagButtonDown:
+			case TagButtonUp:
+				e.type = tag == TagButtonDown ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+				e.button.x = readSigned(); e.button.y = readSigned();
+				e.button.button = uint8_t(read());
+				break;
+			case TagMotion:
+				e.type = SDL_MOUSEMOTION;
+				e.motion.x = readSigned(); e.motion.y = readSigned();
+				break;
+			case TagWheel:
+				e.type = SDL_MOUSEWHEEL;
+				e.wheel.x = readSigned(); e.wheel.y = readSigned();
+				e.wheel.direction = uint32_t(read());
+				break;
+			case TagKeyDown:
+				e.type = SDL_KEYDOWN;
+				e.key.keysym.sym = SDL_Keycode(read());
+				SDL_SetModState(SDL_Keymod(read()));
+				break;
+			case TagText: {
+				e.type = SDL_TEXTINPUT;
+				SDL_SetModState(SDL_Keymod(read()));
+				size_t length = std::min<size_t>(read(), sizeof(e.text.text) - 1);
+				std::memcpy(e.text.text, m_data.data() + m_read, length);
+				m_read += length;
+			} break;
+			default: m_read = m_data.size(); return std::nullopt;
+		}
+		return tag;
+	}
+
+	void rewind() {
+		m_read = 0;
+		m_readTime = 0;
+	}
+
+	void clear() {
+		m_data.clear();
+		m_events = 0;
+		m_hasTime = false;
+		rewind();
+	}
+
+	// Events recorded since the trace was created or cleared
+	size_t events() const { return m_events; }
+	size_t bytes() const { return m_data.size(); }
+
+	bool save(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		out.write(Magic, sizeof(Magic));
+		out.put(char(Version));
+		out.write(reinterpret_cast<const char*>(m_data.data()), std::streamsize(m_data.size()));
+		return bool(out);
+	}
+
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		char magic[sizeof(Magic)];
+		if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) != 0) return false;
+		if (in.get() != Version) return false;
+
+		clear();
+		m_data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+private:
+	static constexpr char Magic[4] = { 'U', 'I', 'T', 'R' };
+	static constexpr int Version = 1;
+
+	std::vector<uint8_t> m_data;
+	size_t m_events{ 0 }, m_read{ 0 };
+	uint64_t m_readTime{ 0 };
+	double m_lastTime{ 0.0 };
+	bool m_hasTime{ false };
+
+	void header(Tag tag, double time) {
+		if (!m_hasTime) {
+			m_lastTime = time;
+			m_hasTime = true;
+		}
+		uint64_t delta = uint64_t(std::llround(std::max(time - m_lastTime, 0.0) * 1e6));
+		// Accumulate the rounded delta so rounding errors don't drift
+		m_lastTime += double(delta) / 1e6;
+
+		m_data.push_back(tag);
+		write(delta);
+	}
+
+	void write(uint64_t v) { internal::writeVarint(m_data, v); }
+	void writeSigned(int64_t v) { internal::writeZigzag(m_data, v); }
+	uint64_t read() { return internal::readVarint(m_data, m_read); }
+	int readSigned() { return int(internal::readZigzag(m_data, m_read)); }
+};
+
+/**
+ * Binary image of a UISystem's widgets: types, names, properties and runtime state.
+ *
+ * Layout: "UISN", version byte, next WID, focused WID and widget count, then per
+ * widget its WID, type index, name and fields in WidgetInfo order. Callbacks
+ * aren't part of it; restoring keeps those of widgets that still exist.
+ */
+class UISnapshot {
+public:
+	struct Change {
+		enum Kind {
+			Added = 0,
+			Removed,
+			Changed
+		} kind;
+		WID id;
+		std::string_view field; // empty unless kind is Changed
+	};
+
+	size_t bytes() const { return m_data.size(); }
+
+	bool save(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(m_data.data()), std::streamsize(m_data.size()));
+		return bool(out);
+	}
+
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		if (data.size() < sizeof(Magic) + 1 || std::memcmp(data.data(), Magic, sizeof(Magic)) != 0 || data[sizeof(Magic)] != Version) {
+			return false;
+		}
+		m_data = std::move(data);
+		return true;
+	}
+
+	/**
+	 * @brief  Lists the widgets and fields that differ between two snapshots
+	 * @param  from: Older snapshot
+	 * @param  to: Newer snapshot
+	 * @retval Changes, in WID order
+	 */
+	static std::vector<Change> diff(const UISnapshot& from, const UISnapshot& to) {
+		auto a = from.index(), b = to.index();
+
+		std::vector<Change> changes;
+		auto ia = a.begin(), ib = b.begin();
+		while (ia != a.end() || ib != b.end()) {
+			if (ib == b.end() || (ia != a.end() && ia->id < ib->id)) {
+				changes.push_back(Change{ .kind = Change::Removed, .id = ia->id, .field = {} });
+				ia++;
+			} else if (ia == a.end() || ib->id < ia->id) {
+				changes.push_back(Change{ .kind = Change::Added, .id = ib->id, .field = {} });
+				ib++;
+			} else {
+				if (ia->type != ib->type) {
+					changes.push_back(Change{ .kind = Change::Removed, .id = ia->id, .field = {} });
+					changes.push_back(Change{ .kind = Change::Added, .id = ib->id, .field = {} });
+				} else {
+					for (size_t i = 0; i < ia->fields.size(); i++) {
+						auto fa = ia->fields[i], fb = ib->fields[i];
+						bool same = fa.end - fa.begin == fb.end - fb.begin &&
+							std::memcmp(from.m_data.data() + fa.begin, to.m_data.data() + fb.begin, fa.end - fa.begin) == 0;
+						if (!same) changes.push_back(Change{ .kind = Change::Changed, .id = ia->id, .field = fa.name });
+					}
+				}
+				ia++; ib++;
+			}
+		}
+		return changes;
+	}
+
+private:
+	friend class UISystem;
+
+	static constexpr char Magic[4] = { 'U', 'I', 'S', 'N' };
+	static constexpr uint8_t Version = 2;
+
+	std::vector<uint8_t> m_data;
+
+	struct FieldRange {
+		std::string_view name;
+		size_t begin, end;
+	};
+
+	struct Entry {
+		WID id;
+		size_t type;
+		std::vector<FieldRange> fields; // the name counts as a field
+	};
+
+	/**
+	 * @brief  Finds where every field is, without keeping the values
+	 */
+	std::vector<Entry> index() const {
+		std::vector<Entry> entries;
+		if (m_data.size() < sizeof(Magic) + 1) return entries;
+
+		size_t pos = sizeof(Magic) + 1;
+		internal::readVarint(m_data, pos); // next WID
+		internal::readVarint(m_data, pos); // focused
+		size_t count = internal::readVarint(m_data, pos);
+
+		std::string name;
+		for (size_t i = 0; i < count && pos < m_data.size(); i++) {
+			Entry e{ .id = WID(internal::readVarint(m_data, pos)), .type = internal::readVarint(m_data, pos), .fields = {} };
+
+			size_t begin = pos;
+			internal::readField(m_data, pos, name);
+			e.fields.push_back(FieldRange{ "id", begin, pos });
+
+			bool known = internal::visitType(e.type, [&]<typename W>(std::type_identity<W>) {
+				W w{};
+				internal::forEachField(w, [&](int, std::string_view field, auto& value) {
+					size_t start = pos;
+					internal::readField(m_data, pos, value);
+					e.fields.push_back(FieldRange{ field, start, pos });
+				});
+			}, WidgetTypes{});
+			if (!known) break;
+
+			entries.push_back(std::move(e));
+		}
+		return entries;
+	}
+};
+
+/**
+ * A widget property resolved ahead of time, so other threads can target it
+ * without looking anything up. See UISystem::handle().
+ */
+struct PropertyHandle {
+	uint64_t key{ ~0ull };
+
+	bool valid() const { return key != ~0ull; }
+};
+
+/**
+ * Property updates from one producer thread (e.g. the audio thread) to the UI.
+ * Pushing never allocates and only waits on SDL's event queue when it wakes the UI,
+ * once per frame at most; the UI drains every queue once per frame and applies only
+ * the latest value of each property.
+ */
+class UpdateQueue {
+public:
+	struct Update {
+		uint64_t key;
+		enum : uint8_t { Int = 0, Float, Bool } type;
+		union {
+			int i;
+			float f;
+			bool b;
+		};
+	};
+
+	UpdateQueue(size_t capacity, WakeSignal& signal) : m_ring(capacity), m_signal(signal) {}
+
+	bool push(PropertyHandle handle, int value) { return push(Update{ .key = handle.key, .type = Update::Int, .i = value }); }
+	bool push(PropertyHandle handle, float value) { return push(Update{ .key = handle.key, .type = Update::Float, .f = value }); }
+	bool push(PropertyHandle handle, bool value) { return push(Update{ .key = handle.key, .type = Update::Bool, .b = value }); }
+
+	/**
+	 * @brief  Updates lost because the queue was full
+	 */
+	size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+	friend class UISystem;
+
+	SpscRing<Update> m_ring;
+	WakeSignal& m_signal;
+	std::atomic<size_t> m_dropped{ 0 };
+
+	bool push(const Update& update) {
+		if (update.key == PropertyHandle{}.key || !m_ring.push(update)) {
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		m_signal.notify();
+		return true;
+	}
+};
+
+/**
+ * Parameters shared with the audio thread. Sliders bind to them by id (`param`);
+ * the UI publishes at most one value per parameter per frame, which the audio
+ * thread reads from atomics without locking.
+ */
+class ParameterStore {
+public:
+	struct Parameter {
+		std::string id;
+		float min, max, def;
+		float smoothing; // seconds the audio side should take to reach a new value
+
+		std::atomic<float> value;
+		std::atomic<uint32_t> version{ 0 }; // bumped on every publish
+	};
+
+	/**
+	 * @brief  Declares a parameter
+	 * @note   Declare every parameter before the audio thread starts reading
+	 * @retval Its index
+	 */
+	size_t add(const std::string& id, float min, float max, float def, float smoothing = 0.0f) {
+		auto param = std::make_unique<Parameter>();
+		param->id = id;
+		param->min = min;
+		param->max = max;
+		param->def = def;
+		param->smoothing = smoothing;
+		param->value.store(def, std::memory_order_relaxed);
+
+		m_index[id] = m_params.size();
+		m_params.push_back(std::move(param));
+		m_pending.push_back(def);
+		m_pendingSet.push_back(0);
+		return m_params.size() - 1;
+	}
+
+	size_t size() const { return m_params.size(); }
+
+	std::optional<size_t> find(std::string_view id) const {
+		auto it = m_index.find(id);
+		if (it == m_index.end()) return std::nullopt;
+		return it->second;
+	}
+
+	// Audio side
+	const Parameter& operator[](size_t index) const { return *m_params[index]; }
+	float value(size_t index) const { return m_params[index]->value.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief  UI side: stages a value, published on the next commit()
+	 */
+	void set(size_t index, float value) {
+		const Parameter& p = *m_params[index];
+		m_pending[index] = std::clamp(value, std::min(p.min, p.max), std::max(p.min, p.max));
+		if (!m_pendingSet[index]) m_pendingList.push_back(index);
+		m_pendingSet[index] = 1;
+	}
+
+	/**
+	 * @brief  UI side: publishes the staged values; UISystem calls this once per frame
+	 */
+	void commit() {
+		for (size_t index : m_pendingList) {
+			Parameter& p = *m_params[index];
+			if (p.value.load(std::memory_order_relaxed) != m_pending[index]) {
+				p.value.store(m_pending[index], std::memory_order_release);
+				p.version.fetch_add(1, std::memory_order_release);
+			}
+			m_pendingSet[index] = 0;
+		}
+		m_pendingList.clear();
+	}
+
+private:
+	std::vector<std::unique_ptr<Parameter>> m_params;
+	std::map<std::string, size_t, std::less<>> m_index;
+
+	std::vector<float> m_pending;
+	std::vector<uint8_t> m_pendingSet;
+	std::vector<size_t> m_pendingList;
+};
+
+/**
+ * Fire-and-forget coroutine for widget callbacks. Starts running when called and is
+ * resumed on the UI thread by UISystem (see UISystem::nextFrame, sleep and background).
+ * @note   Copy anything the task needs into locals before its first co_await: a callback's
+ *         captures may be gone by the time it resumes.
+ */
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
 class UISystem;
 namespace internal {
 	
+	// Widget behaviour is specialized with the UI_WIDGET_*_IMPL macros below.
+	// UISystem's dispatch is defined after all of them, so no forward declarations are needed.
+
 	template<typename W>
 	bool onMouseEvent(Device& dev, const MouseEvent& e, WID wid, W& w, const Context& ctx, UISystem* sys) { return false; }
 
@@ -513,82 +3771,493 @@ namespace internal {
 	template<typename W>
 	Rect bounds(Device& dev, WID wid, W& w, const Context& ctx, UISystem* sys) { return Rect(0, 0, 1, 1); }
 
-	template<typename W>
-	std::string className() { return ""; }
-
-	UI_DECLARE_WIDGET(Root)
-	UI_DECLARE_WIDGET(Text)
-	UI_DECLARE_WIDGET(Button)
-	UI_DECLARE_WIDGET(Placement)
-	UI_DECLARE_WIDGET(Container)
-	UI_DECLARE_WIDGET(Column)
-	UI_DECLARE_WIDGET(Slider)
-	UI_DECLARE_WIDGET_KB(Input)
-	UI_DECLARE_WIDGET(Layout)
+	template<typename W, typename Fn>
+	void forEachChild(W& w, Fn&& fn) {
+		if constexpr (requires { w.child; }) {
+			if (w.child) fn(w.child);
+		}
+		if constexpr (requires { w.children; }) {
+			for (WID cid : w.children) if (cid) fn(cid);
+		}
+		if constexpr (std::is_same_v<W, Layout>) {
+			for (WID cid : { w.top, w.bottom, w.left, w.right, w.center }) if (cid) fn(cid);
+		}
+	}
 
 };
 
 class UISystem {
 public:
 
+	using Transform = std::function<PropertyValue(const PropertyValue&)>;
+
 	template<typename W>
 	WID create(const W& w, const std::string& name = "") {
 		WID id = m_current++;
 		m_widgets[id] = w;
 		if (!name.empty()) m_widgetNames[id] = name;
+		m_layoutDirty = true;
 		return id;
 	}
 
+	// Widgets fetched for mutation are redrawn and invalidate the layout
 	template<typename W>
 	W* get(WID id) {
 		if (m_widgets.find(id) == m_widgets.end()) return nullptr;
+		markDirty(id);
 		return &std::get<W>(m_widgets[id]);
 	}
 
 	template<typename W>
 	W* get(const std::string& name) {
 		for (auto& [k, v] : m_widgetNames) {
-			if (v == name) return &std::get<W>(m_widgets[k]);
+			if (v == name) return get<W>(k);
 		}
 		return nullptr;
 	}
 
-	void draw(Device& dev, WID id, const Context& ctx) {
-		std::vector<int> ids;
-		for (const auto& [key, _] : m_widgets) {
-			ids.push_back(key);
+	WID find(std::string_view name) const {
+		for (auto& [k, v] : m_widgetNames) {
+			if (v == name) return k;
 		}
-		if (id == *std::max_element(ids.begin(), ids.end())) {
-			bounds(dev, id, ctx);
+		return 0;
+	}
+
+	/**
+	 * @brief  Binds a property of one widget to a property of another
+	 * @note   Changes are propagated once per frame, before layout, in dependency order
+	 * @param  source: Source widget
+	 * @param  sourceProp: Source property name (as in .ui files)
+	 * @param  target: Target widget
+	 * @param  targetProp: Target property name
+	 * @param  transform: Optional conversion applied to the value
+	 * @retval false if either property doesn't exist or can't be bound
+	 */
+	bool bind(WID source, std::string_view sourceProp, WID target, std::string_view targetProp, Transform transform = nullptr) {
+		int si = propertyIndex(source, sourceProp), ti = propertyIndex(target, targetProp);
+		if (si < 0 || ti < 0) return false;
+
+		uint64_t src = propertyKey(source, si);
+		m_bindings.push_back(Binding{ .source = src, .target = propertyKey(target, ti), .transform = std::move(transform) });
+		sortBindings();
+		queueChange(src);
+		return true;
+	}
+
+	std::optional<PropertyValue> property(WID id, std::string_view prop) {
+		int index = propertyIndex(id, prop);
+		if (index < 0) return std::nullopt;
+		return std::visit([&](auto&& w) { return internal::getProperty(w, index); }, m_widgets[id]);
+	}
+
+	/**
+	 * @brief  Sets a property by name and schedules propagation to bound properties
+	 * @retval true if the value changed
+	 */
+	bool set(WID id, std::string_view prop, const PropertyValue& value) {
+		int index = propertyIndex(id, prop);
+		if (index < 0) return false;
+		if (!std::visit([&](auto&& w) { return internal::setProperty(w, index, value); }, m_widgets[id])) return false;
+		markDirty(id);
+		queueChange(propertyKey(id, index));
+		return true;
+	}
+
+	/**
+	 * @brief  Notifies that a property was modified in place
+	 * @note   Widgets call this when their state changes, and so should code mutating widgets through get()
+	 * @retval None
+	 */
+	void changed(WID id, std::string_view prop) {
+		markDirty(id);
+		if (m_bindings.empty()) return;
+		int index = propertyIndex(id, prop);
+		if (index >= 0) queueChange(propertyKey(id, index));
+	}
+
+	void markDirty(WID id) {
+		if (id >= m_dirty.size()) {
+			m_dirty.resize(id + 1, 0);
+			m_versions.resize(id + 1, 0);
+		}
+		if (!m_dirty[id]) m_dirtyList.push_back(id);
+		m_dirty[id] = 1;
+		m_versions[id]++;
+		m_layoutDirty = true;
+	}
+
+	/**
+	 * @brief  Whether a widget changed since the last frame was drawn
+	 */
+	bool dirty(WID id) const {
+		return id < m_dirty.size() && m_dirty[id];
+	}
+
+	void invalidateLayout() { m_layoutDirty = true; }
+
+	/**
+	 * @brief  Animates a numeric property from its current value
+	 * @note   Replaces any animation already running on the same property
+	 * @param  id: Widget
+	 * @param  prop: Property name (int or float)
+	 * @param  to: Target value
+	 * @param  duration: Duration in seconds
+	 * @param  easing: Easing curve
+	 * @param  repeat: Whether the animation stops, restarts or reverses at the end
+	 * @retval false if the property doesn't exist or isn't numeric
+	 */
+	bool animate(WID id, std::string_view prop, float to, double duration, Tween::Easing easing = Tween::EaseOut, Tween::Repeat repeat = Tween::Once) {
+		int index = propertyIndex(id, prop);
+		auto value = property(id, index);
+		if (!value) return false;
+
+		float from;
+		if (auto i = std::get_if<int>(&*value)) from = float(*i);
+		else if (auto f = std::get_if<float>(&*value)) from = *f;
+		else return false;
+
+		uint64_t key = propertyKey(id, index);
+		Tween tween{ .key = key, .from = from, .to = to, .start = m_time, .duration = duration, .easing = easing, .repeat = repeat };
+		auto it = std::find_if(m_tweens.begin(), m_tweens.end(), [=](const Tween& t) { return t.key == key; });
+		if (it != m_tweens.end()) *it = tween;
+		else m_tweens.push_back(tween);
+		return true;
+	}
+
+	void stopAnimation(WID id, std::string_view prop) {
+		uint64_t key = propertyKey(id, propertyIndex(id, prop));
+		std::erase_if(m_tweens, [=](const Tween& t) { return t.key == key; });
+	}
+
+	bool animating() const { return !m_tweens.empty(); }
+
+	/**
+	 * @brief  Requests a redraw at a given time, without animating anything
+	 * @note   Requests are cleared every frame, widgets renew them while drawing
+	 * @param  time: Time in seconds, as returned by time()
+	 * @retval None
+	 */
+	void wakeAt(double time) {
+		m_wake = std::min(m_wake, time);
+	}
+
+	/**
+	 * @brief  Time of the frame being drawn, in seconds
+	 */
+	double time() const { return m_time; }
+
+	/**
+	 * @brief  Current time on the same clock, for events handled between frames
+	 */
+	double now() const { return m_clock(); }
+
+	/**
+	 * @brief  Replaces the clock animations are driven by (e.g. for deterministic replays)
+	 */
+	void setClock(double (*clock)()) { m_clock = clock; }
+
+	/**
+	 * @brief  Time until something needs to be redrawn
+	 * @retval Milliseconds to wait, 0 when animating, -1 when idle
+	 */
+	int timeout() const {
+		if (!m_tweens.empty() || !m_ready.empty()) return 0;
+		if (m_completedCount.load(std::memory_order_acquire) > 0) return 0;
+
+		// Update queues and background tasks post a WakeSignal event instead of being polled
+		if (m_wake == Idle) return -1;
+		double ms = std::ceil((m_wake - m_clock()) * 1000.0);
+		return ms > 0.0 ? int(std::min(ms, double(INT32_MAX))) : 0;
+	}
+
+	/**
+	 * @brief  Awaitable resuming a Task at the start of the next frame
+	 */
+	auto nextFrame() {
+		struct Awaiter {
+			UISystem* sys;
+			bool await_ready() const { return false; }
+			void await_suspend(std::coroutine_handle<> h) { sys->m_ready.push_back(h); }
+			void await_resume() const {}
+		};
+		return Awaiter{ this };
+	}
+
+	/**
+	 * @brief  Awaitable resuming a Task once the given time has passed
+	 * @param  seconds: Delay, on the UI clock
+	 */
+	auto sleep(double seconds) {
+		struct Awaiter {
+			UISystem* sys;
+			double due;
+			bool await_ready() const { return false; }
+			void await_suspend(std::coroutine_handle<> h) {
+				sys->m_timers.push_back(Timer{ .due = due, .handle = h });
+				std::push_heap(sys->m_timers.begin(), sys->m_timers.end(), std::greater<>{});
+				sys->wakeAt(due);
+			}
+			void await_resume() const {}
+		};
+		return Awaiter{ this, m_clock() + seconds };
+	}
+
+	/**
+	 * @brief  Awaitable running fn on the worker pool and resuming the Task with its result
+	 * @note   The Task resumes on the UI thread, in the frame after fn returns. Destroying
+	 *         the UISystem waits for running jobs, so fn must not wait on the user (dialogs
+	 *         also belong on the window's thread)
+	 * @param  fn: Callable, run on a worker thread
+	 */
+	template<typename Fn>
+	auto background(Fn fn) {
+		using R = std::invoke_result_t<Fn&>;
+		using Result = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+		struct Awaiter {
+			UISystem* sys;
+			Fn fn;
+			std::optional<Result> result;
+
+			bool await_ready() const { return false; }
+			void await_suspend(std::coroutine_handle<> h) {
+				sys->workers().submit([this, h]() {
+					if constexpr (std::is_void_v<R>) { fn(); result.emplace(); }
+					else result.emplace(fn());
+					sys->completed(h);
+				});
+			}
+			R await_resume() {
+				if constexpr (!std::is_void_v<R>) return std::move(*result);
+			}
+		};
+		return Awaiter{ this, std::move(fn), std::nullopt };
+	}
+
+	/**
+	 * @brief  Limits the time spent resuming tasks in a frame; the rest wait for the next one
+	 * @param  seconds: Budget per frame
+	 */
+	void taskBudget(double seconds) { m_taskBudget = seconds; }
+
+	~UISystem() {
+		// Background jobs finish first, then suspended tasks are destroyed
+		m_workers.reset();
+		for (auto h : m_ready) h.destroy();
+		for (auto& t : m_timers) t.handle.destroy();
+		for (auto h : m_completed) h.destroy();
+	}
+
+	void draw(Device& dev, WID id, const Context& ctx);
+	void bounds(Device& dev, WID id, const Context& ctx);
+	bool processMouse(Device& dev, const MouseEvent& e, WID id, const Context& ctx);
+	void processKeyboard(Device& dev, const KeyboardEvent& e, WID id);
+
+	/**
+	 * @brief  Resolves a property for use from other threads
+	 * @retval Invalid handle if the property doesn't exist
+	 */
+	PropertyHandle handle(WID id, std::string_view prop) {
+		int index = propertyIndex(id, prop);
+		return index < 0 ? PropertyHandle{} : PropertyHandle{ propertyKey(id, index) };
+	}
+
+	/**
+	 * @brief  Attaches the parameters sliders bind to with their `param` property
+	 * @note   Bound sliders take the parameters' current values. Changed sliders are
+	 *         published together at the end of each frame.
+	 * @param  store: Parameters, or nullptr to detach
+	 * @retval None
+	 */
+	void parameters(ParameterStore* store) {
+		m_parameters = store;
+		if (!store) return;
+
+		for (auto& [id, wid] : m_widgets) {
+			auto slider = std::get_if<Slider>(&wid);
+			if (!slider || slider->param.empty()) continue;
+			if (auto index = store->find(slider->param)) {
+				set(id, "value", store->value(*index));
+			}
 		}
-		auto& wid = m_widgets[id];
-		std::visit([&](auto&& w) { internal::draw(dev, id, w, ctx, this); }, wid);
 	}
 
-	void bounds(Device& dev, WID id, const Context& ctx) {
-		auto& wid = m_widgets[id];
-		m_widgetBounds[id] = std::visit([&](auto&& w) { return internal::bounds(dev, id, w, ctx, this); }, wid);
+	/**
+	 * @brief  Creates a queue for one producer thread to push property updates through
+	 * @note   Call from the UI thread. The queue lives as long as this UISystem.
+	 * @param  capacity: Updates that can be pending between two frames
+	 * @retval The queue, to be handed to the producer
+	 */
+	UpdateQueue& createUpdateQueue(size_t capacity = 1024) {
+		m_updateQueues.push_back(std::make_unique<UpdateQueue>(capacity, m_updateSignal));
+		m_drained.reserve(m_drained.capacity() + m_updateQueues.back()->m_ring.capacity());
+		return *m_updateQueues.back();
+	}
+
+	/**
+	 * @brief  Writes every widget, its properties and runtime state, and the focus
+	 * @param  out: Snapshot to overwrite; its buffer is reused
+	 * @retval None
+	 */
+	void snapshot(UISnapshot& out) const {
+		auto& data = out.m_data;
+		data.clear();
+		internal::writeBytes(data, UISnapshot::Magic, sizeof(UISnapshot::Magic));
+		data.push_back(UISnapshot::Version);
+		internal::writeVarint(data, m_current);
+		internal::writeVarint(data, focused);
+		internal::writeVarint(data, m_widgets.size());
+
+		static const std::string unnamed;
+		for (auto& [id, wid] : m_widgets) {
+			internal::writeVarint(data, id);
+			internal::writeVarint(data, wid.index());
+
+			auto name = m_widgetNames.find(id);
+			internal::writeField(data, name != m_widgetNames.end() ? name->second : unnamed);
+
+			std::visit([&](auto&& w) {
+				internal::forEachField(w, [&](int, std::string_view, const auto& value) {
+					internal::writeField(data, value);
+				});
+			}, wid);
+		}
 	}
 
-	bool processMouse(Device& dev, const MouseEvent& e, WID id, const Context& ctx) {
-		auto& wid = m_widgets[id];
-		return std::visit([&](auto&& w) { return internal::onMouseEvent(dev, e, id, w, ctx, this); }, wid);
+	UISnapshot snapshot() const {
+		UISnapshot out;
+		snapshot(out);
+		return out;
 	}
 
-	void processKeyboard(Device& dev, const KeyboardEvent& e, WID id) {
-		if (id == 0) return;
-		auto& wid = m_widgets[id];
-		std::visit([&](auto&& w) { internal::onKeyEvent(dev, e, id, w, this); }, wid);
+	/**
+	 * @brief  Restores a snapshot in a single pass
+	 * @note   Existing widgets are updated in place and keep their callbacks; widgets missing
+	 *         from the snapshot are destroyed. Changed properties propagate through bindings.
+	 * @param  snap: Snapshot taken from this UISystem (or one built from the same .ui)
+	 * @retval false if the snapshot is malformed or from another format version; the
+	 *         widgets read so far are kept
+	 */
+	bool restore(const UISnapshot& snap) {
+		const auto& data = snap.m_data;
+		if (data.size() < sizeof(UISnapshot::Magic) + 1 || std::memcmp(data.data(), UISnapshot::Magic, sizeof(UISnapshot::Magic)) != 0 ||
+			data[sizeof(UISnapshot::Magic)] != UISnapshot::Version) {
+			return false;
+		}
+
+		size_t pos = sizeof(UISnapshot::Magic) + 1;
+		m_current = std::max(m_current, WID(internal::readVarint(data, pos)));
+		focused = WID(internal::readVarint(data, pos));
+		size_t count = internal::readVarint(data, pos);
+
+		m_restored.clear();
+		std::string name;
+		bool ok = true;
+		for (size_t i = 0; i < count; i++) {
+			if (pos >= data.size()) { ok = false; break; }
+
+			WID id = WID(internal::readVarint(data, pos));
+			size_t type = internal::readVarint(data, pos);
+			m_restored.push_back(id);
+
+			internal::readField(data, pos, name);
+			if (name.empty()) m_widgetNames.erase(id);
+			else m_widgetNames[id] = name;
+
+			ok = internal::visitType(type, [&]<typename W>(std::type_identity<W>) {
+				auto it = m_widgets.find(id);
+				if (it == m_widgets.end() || it->second.index() != type) {
+					m_widgets[id] = W{};
+					markDirty(id);
+				}
+
+				W& w = std::get<W>(m_widgets[id]);
+				constexpr int properties = int(std::tuple_size_v<decltype(WidgetInfo<W>::properties)>);
+				internal::forEachField(w, [&](int index, std::string_view, auto& value) {
+					auto previous = value;
+					internal::readField(data, pos, value);
+					if (value == previous) return;
+
+					markDirty(id);
+					if (index < properties && !m_bindings.empty()) queueChange(propertyKey(id, index));
+				});
+			}, WidgetTypes{});
+			if (!ok) break;
+		}
+
+		// Destroy what the snapshot doesn't have
+		if (ok) {
+			std::sort(m_restored.begin(), m_restored.end());
+			for (auto it = m_widgets.begin(); it != m_widgets.end();) {
+				if (std::binary_search(m_restored.begin(), m_restored.end(), it->first)) {
+					++it;
+					continue;
+				}
+				forget(it->first);
+				it = m_widgets.erase(it);
+			}
+		}
+
+		m_layoutDirty = true;
+		return ok;
 	}
 
+	/**
+	 * @brief  Records every event passed to processEvents, and frame boundaries, into a trace
+	 * @param  trace: Trace to append to, or nullptr to stop recording
+	 * @retval None
+	 */
+	void record(InputTrace* trace) { m_trace = trace; }
+
 	void processEvents(Device& dev, const SDL_Event& e, WID id) {
+		UI_PROFILE_SCOPE("UISystem::processEvents");
 		Context ctx{};
+		uint64_t t0 = dev.statsBegin();
+		if (m_trace) m_trace->record(e, m_clock());
+
+		switch (e.type) {
+			default: break;
+			case SDL_MOUSEBUTTONDOWN:
+			case SDL_MOUSEBUTTONUP:
+			case SDL_MOUSEMOTION:
+			case SDL_MOUSEWHEEL:
+			case SDL_KEYDOWN:
+			case SDL_TEXTINPUT:
+				dev.inputConsumed(e.common.timestamp);
+				break;
+		}
 
+		// Clicks and keys may run callbacks that mutate widgets; unhandled motion can't
 		switch (e.type) {
-			case SDL_MOUSEBUTTONDOWN: processMouse(dev, MouseEvent{ .type = MouseEvent::MouseEventDown, .x = e.button.x, .y = e.button.y, .button = e.button.button }, id, ctx); break;
-			case SDL_MOUSEBUTTONUP: processMouse(dev, MouseEvent{ .type = MouseEvent::MouseEventUp, .x = e.button.x, .y = e.button.y, .button = e.button.button }, id, ctx); break;
-			case SDL_MOUSEMOTION: processMouse(dev, MouseEvent{ .type = MouseEvent::MouseEventMove, .x = e.motion.x, .y = e.motion.y }, id, ctx); break;
+			case SDL_MOUSEBUTTONDOWN: {
+				m_layoutDirty = true;
+				m_captured = 0;
+				processMouse(dev, MouseEvent{ .type = MouseEvent::MouseEventDown, .x = e.button.x, .y = e.button.y, .button = e.button.button }, id, ctx);
+			} break;
+			case SDL_MOUSEBUTTONUP: {
+				m_layoutDirty = true;
+				MouseEvent up{ .type = MouseEvent::MouseEventUp, .x = e.button.x, .y = e.button.y, .button = e.button.button };
+				if (m_captured) processCaptured(dev, up);
+				else processMouse(dev, up, id, ctx);
+				m_captured = 0;
+			} break;
+			case SDL_MOUSEMOTION: {
+				m_mouseX = e.motion.x;
+				m_mouseY = e.motion.y;
+				MouseEvent move{ .type = MouseEvent::MouseEventMove, .x = e.motion.x, .y = e.motion.y };
+				if (m_captured ? processCaptured(dev, move) : processMouse(dev, move, id, ctx)) {
+					m_layoutDirty = true;
+				}
+			} break;
+			case SDL_MOUSEWHEEL: {
+				const int dir = e.wheel.direction == SDL_MOUSEWHEEL_FLIPPED ? -1 : 1;
+				m_layoutDirty |= processMouse(dev, MouseEvent{
+					.type = MouseEvent::MouseEventWheel,
+					.x = m_mouseX, .y = m_mouseY,
+					.wheelX = e.wheel.x * dir, .wheelY = e.wheel.y * dir
+				}, id, ctx);
+			} break;
 			case SDL_KEYDOWN: {
+				m_layoutDirty = true;
 				if (SDL_GetModState() & KMOD_CTRL) {
 					processKeyboard(dev, KeyboardEvent{
 						.type = KeyboardEvent::KeyEventCommand,
@@ -602,28 +4271,68 @@ public:
 				}
 			} break;
 			case SDL_TEXTINPUT: {
+				m_layoutDirty = true;
 				if (!(SDL_GetModState() & KMOD_CTRL)) {
-					processKeyboard(dev, KeyboardEvent{
-						.type = KeyboardEvent::KeyEventType,
-						.key = 0,
-						.input = e.text.text[0]
-					}, focused);
+					// One event per byte, so multi-byte UTF-8 input arrives whole
+					for (const char* c = e.text.text; *c; c++) {
+						processKeyboard(dev, KeyboardEvent{
+							.type = KeyboardEvent::KeyEventType,
+							.key = 0,
+							.input = *c
+						}, focused);
+					}
 				}
 			} break;
 		}
+		dev.statsEnd(FrameStats::PhaseEvents, t0);
 	}
 
 	const Rect& bounds(WID id) { return m_widgetBounds[id]; }
 	void updateBounds(WID id, const Rect& r) { m_widgetBounds[id] = r; }
 
+	/**
+	 * @brief  Moves the laid out bounds of a widget and all of its descendants
+	 * @param  id: Subtree root
+	 * @param  dx: Horizontal offset
+	 * @param  dy: Vertical offset
+	 * @retval None
+	 */
+	void translate(WID id, int dx, int dy) {
+		if (dx == 0 && dy == 0) return;
+		auto it = m_widgets.find(id);
+		if (it == m_widgets.end()) return;
+
+		Rect& b = m_widgetBounds[id];
+		b.x += dx;
+		b.y += dy;
+		std::visit([&](auto&& w) { internal::forEachChild(w, [&](WID cid) { translate(cid, dx, dy); }); }, it->second);
+	}
+
+	/**
+	 * @brief  Restricts drawing and mouse dispatch to widgets overlapping a viewport
+	 * @note   Must be balanced with popViewport
+	 * @retval None
+	 */
+	void pushViewport(const Rect& r) {
+		m_viewports.push_back(m_viewports.empty() ? r : r.intersect(m_viewports.back()));
+	}
+
+	void popViewport() {
+		if (!m_viewports.empty()) m_viewports.pop_back();
+	}
+
 	WID focused{ 0 };
 
 	WID loadUI(const std::string& path) {
+		UI_PROFILE_SCOPE("UISystem::loadUI");
 		std::ifstream t(path);
 		std::string str((std::istreambuf_iterator<char>(t)),
 						std::istreambuf_iterator<char>());
 		m_uiDesc = str;
-		return uiParse();
+		m_uiPos = 0;
+		WID root = uiParse();
+		resolveBindings();
+		return root;
 	}
 
 private:
@@ -631,48 +4340,385 @@ private:
 	std::map<WID, Widget> m_widgets;
 	std::map<WID, Rect> m_widgetBounds;
 	std::map<WID, std::string> m_widgetNames;
+	std::vector<Rect> m_viewports;
+	int m_mouseX{ 0 }, m_mouseY{ 0 };
+
+	// The widget that handled the last button press gets the moves and release that follow,
+	// even once the pointer leaves it or its viewport
+	WID m_captured{ 0 };
+
+	bool processCaptured(Device& dev, const MouseEvent& e);
+
+	// Layout is only recomputed when something may have changed it
+	bool m_layoutDirty{ true };
+	int m_layoutGeneration{ -1 };
+	std::pair<int, int> m_layoutSize{ 0, 0 };
+
+	// Widgets changed since the last frame
+	std::vector<uint8_t> m_dirty;
+	std::vector<WID> m_dirtyList;
+
+	// Bumped on every markDirty; display lists recorded at an older version are stale
+	std::vector<uint32_t> m_versions;
+	WID m_drawnFocus{ 0 };
+
+	// A bound property, (widget << 8) | property index
+	struct Binding {
+		uint64_t source, target;
+		Transform transform;
+	};
+
+	// Bindings declared in .ui files, resolved once every widget has been created
+	struct PendingBinding {
+		WID target;
+		std::string targetProp, sourceName, sourceProp;
+	};
+
+	std::vector<Binding> m_bindings; // sorted by dependency order of their source
+	std::vector<uint64_t> m_changedProps, m_propagating;
+	std::vector<PendingBinding> m_pendingBindings;
+
+	static constexpr double Idle = HUGE_VAL;
+
+	static double monotonicClock() {
+		static const double frequency = double(SDL_GetPerformanceFrequency());
+		return double(SDL_GetPerformanceCounter()) / frequency;
+	}
+
+	std::vector<WID> m_restored;
+
+	ParameterStore* m_parameters{ nullptr };
+
+	/**
+	 * @brief  Publishes the values of sliders changed this frame to their parameters
+	 */
+	void commitParameters() {
+		if (!m_parameters) return;
+		for (WID id : m_dirtyList) {
+			auto it = m_widgets.find(id);
+			if (it == m_widgets.end()) continue;
+
+			auto slider = std::get_if<Slider>(&it->second);
+			if (!slider || slider->param.empty()) continue;
+			if (auto index = m_parameters->find(slider->param)) m_parameters->set(*index, slider->value);
+		}
+		m_parameters->commit();
+	}
+
+	friend class ImmediateUI;
+
+	std::vector<std::unique_ptr<UpdateQueue>> m_updateQueues;
+	WakeSignal m_updateSignal;
+	std::vector<std::pair<UpdateQueue::Update, uint32_t>> m_drained; // with arrival order
+
+	// Suspended tasks: ready for the next frame, waiting on a timer, or done in the background
+	struct Timer {
+		double due;
+		std::coroutine_handle<> handle;
+
+		bool operator>(const Timer& o) const { return due > o.due; }
+	};
+
+	std::deque<std::coroutine_handle<>> m_ready;
+	std::vector<Timer> m_timers; // min-heap on due
+	std::vector<std::coroutine_handle<>> m_completed, m_completedSwap;
+	std::mutex m_completedMutex;
+	std::atomic<size_t> m_completedCount{ 0 };
+	WakeSignal m_completedSignal;
+	std::unique_ptr<WorkerPool> m_workers;
+	double m_taskBudget{ 0.002 };
+
+	WorkerPool& workers() {
+		if (!m_workers) m_workers = std::make_unique<WorkerPool>(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+		return *m_workers;
+	}
+
+	// Called on a worker thread
+	void completed(std::coroutine_handle<> h) {
+		std::lock_guard lock(m_completedMutex);
+		m_completed.push_back(h);
+		m_completedCount.store(m_completed.size(), std::memory_order_release);
+		m_completedSignal.notify();
+	}
+
+	/**
+	 * @brief  Resumes tasks that became ready, within the frame's budget
+	 * @note   Tasks suspending again while resumed wait for the next frame
+	 */
+	void resumeTasks() {
+		m_completedSignal.rearm();
+		if (m_completedCount.load(std::memory_order_acquire) > 0) {
+			{
+				std::lock_guard lock(m_completedMutex);
+				m_completedSwap.swap(m_completed);
+				m_completedCount.store(0, std::memory_order_relaxed);
+			}
+			m_ready.insert(m_ready.end(), m_completedSwap.begin(), m_completedSwap.end());
+			m_completedSwap.clear();
+		}
+		while (!m_timers.empty() && m_timers.front().due <= m_time) {
+			m_ready.push_back(m_timers.front().handle);
+			std::pop_heap(m_timers.begin(), m_timers.end(), std::greater<>{});
+			m_timers.pop_back();
+		}
+		if (!m_timers.empty()) wakeAt(m_timers.front().due);
+		if (m_ready.empty()) return;
+
+		UI_PROFILE_SCOPE("UISystem::resumeTasks");
+		const double deadline = monotonicClock() + m_taskBudget;
+		for (size_t count = m_ready.size(); count > 0; count--) {
+			auto h = m_ready.front();
+			m_ready.pop_front();
+			h.resume();
+			if (monotonicClock() >= deadline) break;
+		}
+	}
+
+	/**
+	 * @brief  Applies pending cross-thread updates, keeping the latest value of each property
+	 */
+	void drainUpdates() {
+		m_drained.clear();
+		m_updateSignal.rearm();
+		UpdateQueue::Update update;
+		for (auto& queue : m_updateQueues) {
+			while (queue->m_ring.pop(update)) m_drained.emplace_back(update, uint32_t(m_drained.size()));
+		}
+		if (m_drained.empty()) return;
+
+		std::sort(m_drained.begin(), m_drained.end(), [](const auto& a, const auto& b) {
+			return a.first.key != b.first.key ? a.first.key < b.first.key : a.second < b.second;
+		});
+
+		for (size_t i = 0; i < m_drained.size(); i++) {
+			const auto& u = m_drained[i].first;
+			if (i + 1 < m_drained.size() && m_drained[i + 1].first.key == u.key) continue;
+
+			auto it = m_widgets.find(propertyWidget(u.key));
+			if (it == m_widgets.end()) continue;
+
+			PropertyValue value = u.type == UpdateQueue::Update::Int ? PropertyValue(u.i) :
+				u.type == UpdateQueue::Update::Float ? PropertyValue(u.f) : PropertyValue(u.b);
+			int index = propertyIndex(u.key);
+			if (std::visit([&](auto&& w) { return internal::setProperty(w, index, value); }, it->second)) {
+				markDirty(it->first);
+				queueChange(u.key);
+			}
+		}
+	}
+	double (*m_clock)() { monotonicClock };
+	InputTrace* m_trace{ nullptr };
+	double m_time{ 0.0 }, m_wake{ Idle };
+	std::vector<Tween> m_tweens;
+
+	/**
+	 * @brief  Advances every active tween to the current frame time
+	 */
+	void stepAnimations() {
+		for (size_t i = 0; i < m_tweens.size();) {
+			const Tween& t = m_tweens[i];
+			bool done;
+			float value = t.sample(m_time, done);
+
+			WID id = propertyWidget(t.key);
+			int index = propertyIndex(t.key);
+			auto it = m_widgets.find(id);
+			bool modified = it != m_widgets.end() &&
+				std::visit([&](auto&& w) { return internal::setProperty(w, index, PropertyValue(value)); }, it->second);
+			if (modified) {
+				markDirty(id);
+				queueChange(t.key);
+			}
+
+			if (done || it == m_widgets.end()) {
+				m_tweens[i] = m_tweens.back();
+				m_tweens.pop_back();
+			} else {
+				i++;
+			}
+		}
+	}
+
+	/**
+	 * @brief  Drops everything referring to a widget that is being destroyed
+	 * @note   The widget itself is erased by the caller
+	 */
+	void forget(WID id) {
+		auto refers = [id](uint64_t key) { return propertyWidget(key) == id; };
+		m_widgetNames.erase(id);
+		m_widgetBounds.erase(id);
+		std::erase_if(m_bindings, [&](const Binding& b) { return refers(b.source) || refers(b.target); });
+		std::erase_if(m_pendingBindings, [id](const PendingBinding& p) { return p.target == id; });
+		std::erase_if(m_tweens, [&](const Tween& t) { return refers(t.key); });
+		std::erase_if(m_changedProps, refers);
+		if (focused == id) focused = 0;
+		if (m_captured == id) m_captured = 0;
+		m_destroyed.push_back(id);
+	}
+
+	// Widgets destroyed since the last frame, whose display lists the Device still holds
+	std::vector<WID> m_destroyed;
+
+	void discardDestroyed(Device& dev) {
+		for (WID id : m_destroyed) dev.discardDisplayList(id);
+		m_destroyed.clear();
+	}
+
+	static uint64_t propertyKey(WID id, int index) { return (uint64_t(id) << 8) | uint64_t(index); }
+	static WID propertyWidget(uint64_t key) { return WID(key >> 8); }
+	static int propertyIndex(uint64_t key) { return int(key & 0xFF); }
+
+	int propertyIndex(WID id, std::string_view prop) {
+		auto it = m_widgets.find(id);
+		if (it == m_widgets.end()) return -1;
+		return std::visit([&](auto&& w) {
+			return internal::propertyTable<std::decay_t<decltype(w)>>.find(prop);
+		}, it->second);
+	}
+
+	void queueChange(uint64_t key) {
+		if (std::find(m_changedProps.begin(), m_changedProps.end(), key) == m_changedProps.end()) {
+			m_changedProps.push_back(key);
+		}
+	}
+
+	/**
+	 * @brief  Orders bindings so every property is updated before the bindings reading it
+	 * @note   Kahn's algorithm over the property graph; bindings in cycles go last
+	 */
+	void sortBindings() {
+		std::unordered_map<uint64_t, int> incoming;
+		for (auto& b : m_bindings) {
+			incoming[b.source] += 0;
+			incoming[b.target]++;
+		}
+
+		std::vector<uint64_t> ready;
+		for (auto& [key, n] : incoming) if (n == 0) ready.push_back(key);
+
+		std::unordered_map<uint64_t, int> rank;
+		int next = 0;
+		while (!ready.empty()) {
+			uint64_t key = ready.back();
+			ready.pop_back();
+			rank[key] = next++;
+			for (auto& b : m_bindings) {
+				if (b.source == key && --incoming[b.target] == 0) ready.push_back(b.target);
+			}
+		}
+
+		auto rankOf = [&](uint64_t key) {
+			auto it = rank.find(key);
+			return it == rank.end() ? next : it->second;
+		};
+		std::stable_sort(m_bindings.begin(), m_bindings.end(), [&](const Binding& a, const Binding& b) {
+			return rankOf(a.source) < rankOf(b.source);
+		});
+	}
+
+	/**
+	 * @brief  Applies every queued property change to its bound properties, once
+	 */
+	void propagate() {
+		if (m_changedProps.empty()) return;
+
+		std::swap(m_propagating, m_changedProps);
+		m_changedProps.clear();
+
+		for (size_t i = 0; i < m_bindings.size(); i++) {
+			auto& b = m_bindings[i];
+			if (std::find(m_propagating.begin(), m_propagating.end(), b.source) == m_propagating.end()) continue;
+
+			auto value = property(propertyWidget(b.source), propertyIndex(b.source));
+			if (!value) continue;
+			if (b.transform) value = b.transform(*value);
+
+			WID target = propertyWidget(b.target);
+			int index = propertyIndex(b.target);
+			auto it = m_widgets.find(target);
+			if (it == m_widgets.end()) continue;
+			bool modified = std::visit([&](auto&& w) { return internal::setProperty(w, index, *value); }, it->second);
+			if (modified) {
+				markDirty(target);
+				if (std::find(m_propagating.begin(), m_propagating.end(), b.target) == m_propagating.end()) {
+					m_propagating.push_back(b.target);
+				}
+
+				// Cycles settle one step per frame instead of looping here
+				for (size_t j = 0; j <= i; j++) {
+					if (m_bindings[j].source == b.target) {
+						queueChange(b.target);
+						break;
+					}
+				}
+			}
+		}
+		m_propagating.clear();
+	}
+
+	std::optional<PropertyValue> property(WID id, int index) {
+		auto it = m_widgets.find(id);
+		if (it == m_widgets.end()) return std::nullopt;
+		return std::visit([&](auto&& w) { return internal::getProperty(w, index); }, it->second);
+	}
+
+	void resolveBindings() {
+		for (auto& p : m_pendingBindings) {
+			bind(find(p.sourceName), p.sourceProp, p.target, p.targetProp);
+		}
+		m_pendingBindings.clear();
+	}
+
+	void clearDirty() {
+		for (WID id : m_dirtyList) m_dirty[id] = 0;
+		m_dirtyList.clear();
+	}
 
 	std::string m_uiDesc{};
+	size_t m_uiPos{ 0 };
+
 	char uiRead() {
-		if (m_uiDesc.empty()) return 0;
-		char c = m_uiDesc[0];
-		m_uiDesc.erase(0, 1);
-		return c;
+		if (m_uiPos >= m_uiDesc.size()) return 0;
+		return m_uiDesc[m_uiPos++];
 	}
 
-	std::string uiReadCount(int count) {
-		std::string acc = "";
-		for (int i = 0; i < count; i++) acc += uiRead();
+	std::string_view uiReadCount(int count) {
+		size_t start = m_uiPos;
+		m_uiPos = std::min(m_uiPos + count, m_uiDesc.size());
+		std::string_view acc(m_uiDesc.data() + start, m_uiPos - start);
 		uiCleanSpaces();
 		return acc;
 	}
 
-	char uiPeek() { return m_uiDesc[0]; }
+	char uiPeek() { return m_uiPos < m_uiDesc.size() ? m_uiDesc[m_uiPos] : 0; }
 
 	void uiCleanSpaces() {
 		while (::isspace(uiPeek()) && uiPeek() != 0) uiRead();
 	}
 
 	float uiRead_Number() {
-		std::string acc = "";
+		size_t start = m_uiPos;
+		if (uiPeek() == '-') uiRead();
 		while ((::isdigit(uiPeek()) || uiPeek() == '.') && uiPeek() != 0) {
-			acc += uiRead();
+			uiRead();
 		}
+		float value = 0.0f;
+		std::from_chars(m_uiDesc.data() + start, m_uiDesc.data() + m_uiPos, value);
 		uiCleanSpaces();
-		return std::stof(acc);
+		return value;
 	}
 
 	bool uiRead_Bool() {
-		std::string id = uiRead_ID();
-		if (id == "true") return true;
-		return false;
+		return uiRead_ID() == "true";
 	}
 
-	std::string uiRead_ID() {
-		std::string acc = "";
+	// The returned view points into m_uiDesc
+	std::string_view uiRead_ID() {
+		size_t start = m_uiPos;
 		while (::isalpha(uiPeek()) && uiPeek() != 0) {
-			acc += uiRead();
+			uiRead();
 		}
+		std::string_view acc(m_uiDesc.data() + start, m_uiPos - start);
 		uiCleanSpaces();
 		return acc;
 	}
@@ -680,28 +4726,29 @@ private:
 	std::string uiRead_String() {
 		// assuming there's a quote
 		if (uiPeek() == '"') uiRead();
-		std::string acc = "";
+		size_t start = m_uiPos;
 		while (uiPeek() != '"' && uiPeek() != 0) {
-			acc += uiRead();
+			uiRead();
 		}
+		std::string acc = m_uiDesc.substr(start, m_uiPos - start);
 		uiRead();
 		uiCleanSpaces();
 		return acc;
 	}
 
-	std::string uiBeginParseWidget() {
+	std::string_view uiBeginParseWidget() {
 		uiCleanSpaces();
 
 		if (!::isalpha(uiPeek())) {
-			return "";
+			return {};
 		}
 
 		// Widget class
-		std::string cls = uiRead_ID();
+		std::string_view cls = uiRead_ID();
 
 		// expect (
 		if (uiPeek() != '(') {
-			return "";
+			return {};
 		}
 		uiRead();
 		uiCleanSpaces();
@@ -721,18 +4768,24 @@ private:
 	}
 
 	Color uiParseColor() {
-		uint8_t r, g, b;
+		auto hex = [](std::string_view str) {
+			int v = 0;
+			std::from_chars(str.data(), str.data() + str.size(), v, 16);
+			return uint8_t(v);
+		};
+
+		uint8_t r = 0, g = 0, b = 0;
 		if (uiPeek() == '#') {
 			uiRead();
 			if (!::isxdigit(uiPeek())) return Color{ .r = r, .g = g, .b = b };
 
-			r = std::stoi(uiReadCount(2), 0, 16);
+			r = hex(uiReadCount(2));
 			if (!::isxdigit(uiPeek())) return Color{ .r = r, .g = g, .b = b };
 
-			g = std::stoi(uiReadCount(2), 0, 16);
+			g = hex(uiReadCount(2));
 			if (!::isxdigit(uiPeek())) return Color{ .r = r, .g = g, .b = b };
 
-			b = std::stoi(uiReadCount(2), 0, 16);
+			b = hex(uiReadCount(2));
 		} else {
 			uiBeginParseWidget();
 			if (!::isdigit(uiPeek())) return Color{ .r = r, .g = g, .b = b };
@@ -757,7 +4810,7 @@ private:
 
 	Alignment uiParseAlignment() {
 		Alignment ret = Alignment::Center;
-		std::string id = uiRead_ID();
+		std::string_view id = uiRead_ID();
 		if (id == "NEAR") ret = Alignment::Near;
 		else if (id == "CENTER") ret = Alignment::Center;
 		else if (id == "FAR") ret = Alignment::Far;
@@ -765,109 +4818,142 @@ private:
 		return ret;
 	}
 
-	std::string uiReadProp() {
-		std::string id = uiRead_ID();
+	// Reads a list of widgets: [ A(...), B(...) ]
+	std::vector<WID> uiParseList() {
+		std::vector<WID> ret;
+		if (uiPeek() != '[') return ret;
+		uiRead();
+		uiCleanSpaces();
+		while (uiPeek() != ']' && uiPeek() != 0) {
+			size_t at = m_uiPos;
+			if (WID id = uiParse()) ret.push_back(id);
+			if (uiPeek() == ',') {
+				uiRead();
+				uiCleanSpaces();
+			} else if (m_uiPos == at) {
+				uiRead();
+			}
+		}
+		uiRead();
+		uiCleanSpaces();
+		return ret;
+	}
+
+	// Skips a property value of unknown type, including nested widgets
+	void uiSkipValue() {
+		int depth = 0;
+		while (uiPeek() != 0) {
+			char c = uiPeek();
+			if (depth == 0 && (c == ',' || c == ')' || c == ']')) break;
+			if (c == '"') {
+				uiRead_String();
+				continue;
+			}
+			if (c == '(' || c == '[') depth++;
+			else if (c == ')' || c == ']') depth--;
+			uiRead();
+		}
+		uiCleanSpaces();
+	}
+
+	void uiReadValue(std::string& v) { v = uiRead_String(); }
+	void uiReadValue(int& v) { v = int(uiRead_Number()); }
+	void uiReadValue(float& v) { v = uiRead_Number(); }
+	void uiReadValue(bool& v) { v = uiRead_Bool(); }
+	void uiReadValue(Color& v) { v = uiParseColor(); }
+	void uiReadValue(Alignment& v) { v = uiParseAlignment(); }
+	void uiReadValue(uint32_t& v) { v = uint32_t(uiRead_Number()); }
+	void uiReadChild(WID& v) { v = uiParse(); }
+	void uiReadChild(std::vector<WID>& v) { v = uiParseList(); }
+
+	std::string_view uiReadProp() {
+		std::string_view id = uiRead_ID();
 		if (uiPeek() == ':') {
 			uiRead();
 			uiCleanSpaces();
 			return id;
 		}
-		return "";
+		return {};
 	}
 
-	std::string uiReadAllProps(const std::function<void(const std::string&)>& cb) {
+	/**
+	 * @brief  Parses the properties of a widget of type W and creates it
+	 * @note   Property names are resolved through the widget's perfect hash table,
+	 *         then parsed by a setter generated from its WidgetInfo entry
+	 */
+	template<typename W>
+	WID uiParseWidget() {
+		using Setter = void (*)(UISystem&, W&);
+		static constexpr auto setters = []<size_t... I>(std::index_sequence<I...>) {
+			return std::array<Setter, sizeof...(I)>{
+				[](UISystem& sys, W& w) {
+					constexpr auto property = std::get<I>(WidgetInfo<W>::properties);
+					if constexpr (property.child) sys.uiReadChild(w.*(property.member));
+					else sys.uiReadValue(w.*(property.member));
+				}...
+			};
+		}(std::make_index_sequence<std::tuple_size_v<decltype(WidgetInfo<W>::properties)>>{});
+
+		W w{};
 		std::string name = "";
+		size_t firstBinding = m_pendingBindings.size();
 		while (uiPeek() != ')' && uiPeek() != 0) {
-			std::string id = uiReadProp();
-			if (id == "") continue;
+			std::string_view id = uiReadProp();
+			if (id.empty()) {
+				if (!::isalpha(uiPeek())) uiRead();
+				continue;
+			}
+
 			if (id == "id") {
 				name = uiRead_String();
-				if (uiPeek() == ',') uiRead();
-				continue;
+			} else if (uiPeek() == '@') {
+				// Binding to another widget's property: @name.property
+				uiRead();
+				size_t start = m_uiPos;
+				while (::isalnum(uiPeek()) || uiPeek() == '_') uiRead();
+				std::string source = m_uiDesc.substr(start, m_uiPos - start);
+				std::string sourceProp = "value";
+				if (uiPeek() == '.') {
+					uiRead();
+					sourceProp = uiRead_ID();
+				}
+				uiCleanSpaces();
+				m_pendingBindings.push_back(PendingBinding{ .target = 0, .targetProp = std::string(id), .sourceName = source, .sourceProp = sourceProp });
+			} else if (int index = internal::propertyTable<W>.find(id); index >= 0) {
+				setters[index](*this, w);
+			} else {
+				uiSkipValue();
 			}
-			cb(id);
-			if (uiPeek() == ',') uiRead();
+
+			if (uiPeek() == ',') {
+				uiRead();
+				uiCleanSpaces();
+			}
+		}
+
+		WID ret = create(w, name);
+		// Nested widgets were created first and already claimed their own bindings
+		for (size_t i = firstBinding; i < m_pendingBindings.size(); i++) {
+			if (m_pendingBindings[i].target == 0) m_pendingBindings[i].target = ret;
 		}
-		return name;
+		return ret;
 	}
 
 	WID uiParse() {
-		std::string clas = uiBeginParseWidget();
-		if (clas.empty()) return 0;
+		using Parser = WID (UISystem::*)();
+		static constexpr auto parsers = []<typename... Ts>(TypeList<Ts...>) {
+			return std::array<Parser, sizeof...(Ts)>{ &UISystem::uiParseWidget<Ts>... };
+		}(WidgetTypes{});
 
-		/*
-		Root, Container, Layout, Column, Placement,
-	Text, Button, Slider, Input*/
+		std::string_view clas = uiBeginParseWidget();
+		if (clas.empty()) return 0;
 
 		WID ret = 0;
-		if (clas == internal::className<Text>()) {
-			Text w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "text") w.text = uiRead_String();
-				else if (id == "color") w.color = uiParseColor();
-				else if (id == "align") w.align = uiParseAlignment();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Root>()) {
-			Root w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "child") w.child = uiParse();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Placement>()) {
-			Placement w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "child") w.child = uiParse();
-				else if (id == "x") w.x = uiRead_Number();
-				else if (id == "y") w.y = uiRead_Number();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Container>()) {
-			Container w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "child") w.child = uiParse();
-				else if (id == "width") w.width = int(uiRead_Number());
-				else if (id == "height") w.height = int(uiRead_Number());
-				else if (id == "background") w.background = uiRead_Bool();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Layout>()) {
-			Layout w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "center") w.center = uiParse();
-				else if (id == "left") w.left = uiParse();
-				else if (id == "right") w.right = uiParse();
-				else if (id == "top") w.top = uiParse();
-				else if (id == "bottom") w.bottom = uiParse();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Button>()) {
-			Button w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "text") w.text = uiRead_String();
-				else if (id == "disabled") w.disabled = uiRead_Bool();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Input>()) {
-			Input w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "text") w.text = uiRead_String();
-				else if (id == "pattern") w.pattern = uiRead_String();
-				else if (id == "masked") w.masked = uiRead_Bool();
-				else if (id == "disabled") w.disabled = uiRead_Bool();
-			});
-			ret = create(w, name);
-		} else if (clas == internal::className<Slider>()) {
-			Slider w{};
-			auto name = uiReadAllProps([&](const std::string& id) {
-				if (id == "min") w.min = int(uiRead_Number());
-				else if (id == "max") w.max = int(uiRead_Number());
-				else if (id == "value") w.value = int(uiRead_Number());
-				else if (id == "disabled") w.disabled = uiRead_Bool();
-			});
-			ret = create(w, name);
-		} 
-		// TODO: Read Column (Parse Lists)
+		if (int type = internal::classTable.find(clas); type >= 0) {
+			ret = (this->*parsers[type])();
+		} else {
+			uiSkipValue();
+		}
 		uiEndParseWidget();
 		return ret;
 	}
@@ -968,9 +5054,9 @@ UI_WIDGET_DRAW_IMPL(Input) {
 		dev.drawPatch(sys->focused == wid ? 5 : 4, pb.x, pb.y, pb.width, pb.height);
 	}
 
-	std::string text = w.masked ? std::string(w.text.size(), '*') : w.text;
+	const char mask = w.masked ? '*' : 0;
 	int& vx = w.__viewx;
-	int cursorX = dev.textWidth(text.substr(0, w.__cursor));
+	int cursorX = dev.textWidth(std::string_view(w.text).substr(0, w.__cursor), mask);
 
 	uint8_t shade = w.disabled ? 37 : 255;
 
@@ -979,15 +5065,23 @@ UI_WIDGET_DRAW_IMPL(Input) {
 
 	dev.clip(tb.x, tb.y, tb.width, tb.height);
 	dev.drawText(
-		text,
+		w.text,
 		pb.x - vx,
 		pb.y + (pb.height / 2 - dev.cellHeight() / 2),
-		shade, shade, shade
+		shade, shade, shade,
+		mask
 	);
 	dev.unclip();
 
 	if (!w.disabled && sys->focused == wid) {
-		dev.drawText("|", (pb.x + cursorX) - vx, pb.y + (pb.height / 2 - dev.cellHeight() / 2), 255, 255, 255);
+		// The cursor blinks, restarting after every edit
+		constexpr double BlinkPeriod = 0.5;
+		double phase = std::floor((sys->time() - w.__blinkStart) / BlinkPeriod);
+		sys->wakeAt(w.__blinkStart + (phase + 1.0) * BlinkPeriod);
+
+		if (int64_t(phase) % 2 == 0) {
+			dev.drawText("|", (pb.x + cursorX) - vx, pb.y + (pb.height / 2 - dev.cellHeight() / 2), 255, 255, 255);
+		}
 	}
 
 	// dev.debugRect(tb.x, tb.y, tb.width, tb.height);
@@ -997,13 +5091,23 @@ UI_WIDGET_BOUNDS_IMPL(Input) {
 	return ctx.bounds;
 }
 
+static int utf8Prev(const std::string& str, int i) {
+	if (i <= 0) return 0;
+	do { i--; } while (i > 0 && (uint8_t(str[i]) & 0xC0) == 0x80);
+	return i;
+}
+
+static int utf8After(const std::string& str, int i) {
+	size_t next = size_t(i);
+	if (next < str.size()) utf8Next(str, next);
+	return int(next);
+}
+
 static void updateView(WID wid, Input& w, Device& dev, UISystem* sys) {
-	std::string text = w.masked ? std::string(w.text.size(), '*') : w.text;
 	Rect pb = sys->bounds(wid);
-	auto& cx = w.__cursor;
 	auto& vx = w.__viewx;
 	const int margin = dev.cellWidth();
-	int cursorX = dev.textWidth(text.substr(0, w.__cursor)) - margin / 2;
+	int cursorX = dev.textWidth(std::string_view(w.text).substr(0, w.__cursor), w.masked ? '*' : 0) - margin / 2;
 	if (cursorX-vx > pb.width-margin) vx = cursorX - (pb.width-margin);
 	else if (cursorX-vx < 0) vx = cursorX;
 }
@@ -1016,6 +5120,8 @@ UI_WIDGET_KEY_EVENT_IMPL(Input) {
 	auto& cx = w.__cursor;
 	auto& vx = w.__viewx;
 	const int margin = dev.cellWidth();
+	const size_t length = w.text.size();
+	w.__blinkStart = sys->now();
 
 	if (e.type == KeyboardEvent::KeyEventType) {
 		if (std::regex_match(std::to_string(e.input), std::regex(w.pattern))) {
@@ -1025,14 +5131,19 @@ UI_WIDGET_KEY_EVENT_IMPL(Input) {
 	} else if (e.type == KeyboardEvent::KeyEventDown) {
 		switch (e.key) {
 			default: break;
+			// The cursor is a byte offset, kept on UTF-8 sequence boundaries
 			case SDLK_LEFT: {
-				if (cx > 0) cx--;
+				cx = utf8Prev(w.text, cx);
 			} break;
 			case SDLK_RIGHT: {
-				if (cx < w.text.size()) cx++;
+				cx = utf8After(w.text, cx);
+			} break;
+			case SDLK_DELETE: w.text.erase(cx, utf8After(w.text, cx) - cx); break;
+			case SDLK_BACKSPACE: {
+				int prev = utf8Prev(w.text, cx);
+				w.text.erase(prev, cx - prev);
+				cx = prev;
 			} break;
-			case SDLK_DELETE: if (w.text.substr(cx).size() > 0) w.text.erase(cx, 1); break;
-			case SDLK_BACKSPACE: if (w.text.substr(0, cx).size() > 0) w.text.erase(--cx, 1); break;
 			case SDLK_HOME: cx = 0; break;
 			case SDLK_END: cx = w.text.size(); break;
 		}
@@ -1047,10 +5158,21 @@ UI_WIDGET_KEY_EVENT_IMPL(Input) {
 		}
 		updateView(wid, w, dev, sys);
 	}
+
+	// Every edit inserts or erases; cursor moves only redraw
+	if (w.text.size() != length) sys->changed(wid, "text");
+	else sys->markDirty(wid);
 }
 
 UI_WIDGET_DRAW_IMPL(Slider) {
-	std::string txt = std::to_string(w.value);
+	// As many decimals as the step needs
+	int decimals = 0;
+	if (w.step <= 0.0f) decimals = 3;
+	else {
+		for (float scaled = w.step; decimals < 6 && std::abs(scaled - std::round(scaled)) > 1e-3f; scaled *= 10.0f) decimals++;
+	}
+	char buf[32];
+	std::string_view txt(buf, std::snprintf(buf, sizeof(buf), "%.*f", decimals, w.value));
 	int textWidth = dev.textWidth(txt) + 12;
 
 	Rect pb = sys->bounds(wid);
@@ -1210,6 +5332,58 @@ UI_WIDGET_BOUNDS_IMPL(Column) {
 	return Rect(ctx.bounds.x, ctx.bounds.y, wh, ht);
 }
 
+static void scrollTo(ScrollView& w, int x, int y, const Rect& view, UISystem* sys) {
+	x = w.horizontal ? std::clamp(x, 0, std::max(w.__contentWidth - view.width, 0)) : 0;
+	y = w.vertical ? std::clamp(y, 0, std::max(w.__contentHeight - view.height, 0)) : 0;
+
+	// The child subtree was laid out at the unscrolled origin, so just move it
+	if (w.child) sys->translate(w.child, w.scrollX - x, w.scrollY - y);
+	w.scrollX = x;
+	w.scrollY = y;
+}
+
+UI_WIDGET_DRAW_IMPL(ScrollView) {
+	Rect pb = sys->bounds(wid);
+	if (w.child == 0) return;
+
+	dev.clip(pb.x, pb.y, pb.width, pb.height);
+	sys->pushViewport(pb);
+	sys->draw(dev, w.child, Context{ .bounds = sys->bounds(w.child) });
+	sys->popViewport();
+	dev.unclip();
+
+	// Scroll thumbs
+	const int tw = dev.patchPadding() * 2;
+	if (w.vertical && w.__contentHeight > pb.height) {
+		int th = std::max(pb.height * pb.height / w.__contentHeight, tw);
+		int ty = (pb.height - th) * w.scrollY / (w.__contentHeight - pb.height);
+		dev.drawPatch(0, pb.x + pb.width - tw, pb.y + ty, tw, th);
+	}
+	if (w.horizontal && w.__contentWidth > pb.width) {
+		int th = std::max(pb.width * pb.width / w.__contentWidth, tw);
+		int tx = (pb.width - th) * w.scrollX / (w.__contentWidth - pb.width);
+		dev.drawPatch(0, pb.x + tx, pb.y + pb.height - tw, th, tw);
+	}
+}
+
+UI_WIDGET_BOUNDS_IMPL(ScrollView) {
+	Rect b = Rect(ctx.bounds.x, ctx.bounds.y, w.width, w.height);
+	if (w.width <= 0) b.width = ctx.bounds.width;
+	if (w.height <= 0) b.height = ctx.bounds.height;
+	if (w.child == 0) return b;
+
+	// Lay out the content unscrolled, then offset it by the current scroll position
+	sys->bounds(dev, w.child, Context{ .bounds = b });
+	Rect cb = sys->bounds(w.child);
+	w.__contentWidth = std::max(cb.x + cb.width - b.x, b.width);
+	w.__contentHeight = std::max(cb.y + cb.height - b.y, b.height);
+
+	int x = w.scrollX, y = w.scrollY;
+	w.scrollX = w.scrollY = 0;
+	scrollTo(w, x, y, b, sys);
+	return b;
+}
+
 // --------------- EVENTS
 
 UI_WIDGET_MOUSE_EVENT_IMPL(Button) {
@@ -1220,10 +5394,12 @@ UI_WIDGET_MOUSE_EVENT_IMPL(Button) {
 			if (w.state == ButtonState::ButtonStateNormal) {
 				if (b.has(e.x, e.y)) {
 					w.state = ButtonState::ButtonStateHover;
+					sys->markDirty(wid);
 				}
 			} else if (w.state == ButtonState::ButtonStateHover) {
 				if (!b.has(e.x, e.y)) {
 					w.state = ButtonState::ButtonStateNormal;
+					sys->markDirty(wid);
 				}
 			}
 		} break;
@@ -1231,11 +5407,13 @@ UI_WIDGET_MOUSE_EVENT_IMPL(Button) {
 			if (w.state == ButtonState::ButtonStateHover) {
 				sys->focused = wid;
 				w.state = ButtonState::ButtonStatePressed;
+				sys->markDirty(wid);
 				return true;
 			}
 		} break;
 		case MouseEvent::MouseEventUp: {
 			if (w.state == ButtonState::ButtonStatePressed) {
+				sys->markDirty(wid);
 				if (b.has(e.x, e.y)) {
 					if (w.onPressed) w.onPressed();
 					w.state = ButtonState::ButtonStateHover;
@@ -1245,12 +5423,12 @@ UI_WIDGET_MOUSE_EVENT_IMPL(Button) {
 				}
 			}
 		} break;
+		default: break;
 	}
 	return false;
 }
 
 UI_WIDGET_MOUSE_EVENT_IMPL(Slider) {
-	std::string txt = std::to_string(w.value);
 	Rect b = sys->bounds(wid);
 	Rect track(b.x + SliderThumbWidth / 2, b.y, b.width - SliderThumbWidth, SliderThumbWidth);
 
@@ -1263,9 +5441,12 @@ UI_WIDGET_MOUSE_EVENT_IMPL(Slider) {
 		}
 
 		float ratio = float(e.x - track.x) / track.width;
-		int newValue = std::clamp(w.min + int(ratio * (w.max - w.min)), w.min, w.max);
+		float newValue = w.min + ratio * (w.max - w.min);
+		if (w.step > 0.0f) newValue = w.min + std::round((newValue - w.min) / w.step) * w.step;
+		newValue = std::clamp(newValue, std::min(w.min, w.max), std::max(w.min, w.max));
 		if (newValue != w.value) {
 			w.value = newValue;
+			sys->changed(wid, "value");
 			if (w.onChange) w.onChange(w.value);
 			return true;
 		}
@@ -1273,17 +5454,23 @@ UI_WIDGET_MOUSE_EVENT_IMPL(Slider) {
 		return false;
 	};
 
+	const auto state = w.__state;
+	bool handled = false;
 	if (e.type == MouseEvent::MouseEventDown) {
 		w.__state = ButtonState::ButtonStatePressed;
-		return sliderBehavior();
+		// A press on the slider takes the drag even if the value doesn't change
+		handled = sliderBehavior() || w.__state == ButtonState::ButtonStatePressed;
 	} else if (e.type == MouseEvent::MouseEventMove) {
 		if (w.__state == ButtonState::ButtonStatePressed) {
-			return sliderBehavior();
+			handled = sliderBehavior();
 		}
 	} else if (e.type == MouseEvent::MouseEventUp) {
 		w.__state = ButtonState::ButtonStateNormal;
 	}
-	return false;
+
+	// The value balloon shows while pressed
+	if (w.__state != state) sys->markDirty(wid);
+	return handled;
 }
 
 UI_WIDGET_MOUSE_EVENT_IMPL(Text) { return false; }
@@ -1322,15 +5509,629 @@ UI_WIDGET_MOUSE_EVENT_IMPL(Column) {
 	return false;
 }
 
+UI_WIDGET_MOUSE_EVENT_IMPL(ScrollView) {
+	if (w.child == 0) return false;
+	Rect pb = sys->bounds(wid);
+	if (!pb.has(e.x, e.y)) return false;
+
+	sys->pushViewport(pb);
+	bool handled = sys->processMouse(dev, e, w.child, Context{ .bounds = sys->bounds(w.child) });
+	sys->popViewport();
+	if (handled || e.type != MouseEvent::MouseEventWheel) return handled;
+
+	int x = w.scrollX - e.wheelX * w.step;
+	int y = w.scrollY - e.wheelY * w.step;
+	if (!w.vertical && e.wheelX == 0) x = w.scrollX - e.wheelY * w.step;
+
+	int ox = w.scrollX, oy = w.scrollY;
+	scrollTo(w, x, y, pb, sys);
+	return ox != w.scrollX || oy != w.scrollY;
+}
+
 UI_WIDGET_MOUSE_EVENT_IMPL(Input) {
 	if (w.disabled) return false;
 	Rect b = sys->bounds(wid);
 	if (b.has(e.x, e.y) && e.type == MouseEvent::MouseEventDown) {
 		updateView(wid, w, dev, sys);
 		sys->focused = wid;
+		w.__blinkStart = sys->now();
 		return true;
 	}
 	return false;
 }
 
+// Sources wake the loop when samples arrive; a falling meter redraws at this interval
+constexpr double MeterDecayInterval = 1.0 / 60.0;
+
+UI_WIDGET_DRAW_IMPL(Meter) {
+	Rect pb = sys->bounds(wid);
+	dev.drawPatch(4, pb.x, pb.y, pb.width, pb.height);
+
+	float peak = 0.0f;
+	if (w.source) {
+		float block[256];
+		w.source->rearm();
+		while (size_t n = w.source->pop(block, std::size(block))) {
+			for (size_t i = 0; i < n; i++) peak = std::max(peak, std::abs(block[i]));
+		}
+	}
+
+	const double dt = std::clamp(sys->time() - w.__lastTime, 0.0, 1.0);
+	w.__lastTime = sys->time();
+	w.__level = std::clamp(std::max(peak, w.__level - float(w.decay * dt)), 0.0f, 1.0f);
+	if (w.__level > 0.0f) sys->wakeAt(sys->time() + MeterDecayInterval);
+
+	Rect tb(pb);
+	tb.pad(GlobalPadding, GlobalPadding, GlobalPadding, GlobalPadding);
+	if (!tb.valid()) return;
+
+	// The bar is one column per pixel across, filled from the bottom (or left)
+	const int length = w.vertical ? tb.height : tb.width;
+	const int filled = int(w.__level * float(length) + 0.5f);
+	if (filled <= 0) return;
+
+	const int columns = w.vertical ? tb.width : filled;
+	w.__spans.resize(size_t(columns) * 2);
+	for (int i = 0; i < columns; i++) {
+		w.__spans[i * 2] = int16_t(w.vertical ? tb.height - filled : 0);
+		w.__spans[i * 2 + 1] = int16_t(tb.height - 1);
+	}
+
+	const bool hot = w.__level > 0.9f;
+	dev.drawColumns(tb.x, tb.y, w.__spans.data(), columns, hot ? 255 : 80, hot ? 80 : 255, 80);
+}
+
+UI_WIDGET_BOUNDS_IMPL(Meter) {
+	Rect b = Rect(ctx.bounds.x, ctx.bounds.y, w.width, w.height);
+	if (w.width <= 0) b.width = ctx.bounds.width;
+	if (w.height <= 0) b.height = ctx.bounds.height;
+	return b;
+}
+
+UI_WIDGET_DRAW_IMPL(Scope) {
+	Rect pb = sys->bounds(wid);
+	dev.drawPatch(4, pb.x, pb.y, pb.width, pb.height);
+
+	const size_t history = size_t(std::max(w.samples, 1));
+	if (w.__history.size() != history) {
+		w.__history.assign(history, 0.0f);
+		w.__write = 0;
+	}
+
+	// Drain straight into the history, which is a ring too
+	if (w.source) {
+		w.source->rearm();
+		while (size_t n = w.source->pop(w.__history.data() + w.__write, history - w.__write)) {
+			w.__write = (w.__write + n) % history;
+		}
+	}
+
+	Rect tb(pb);
+	tb.pad(GlobalPadding, GlobalPadding, GlobalPadding, GlobalPadding);
+	if (!tb.valid()) return;
+
+	// Decimate to one min/max pair per pixel column, oldest sample on the left
+	const int columns = tb.width;
+	const float half = float(tb.height - 1) * 0.5f;
+	w.__spans.resize(size_t(columns) * 2);
+
+	for (int c = 0; c < columns; c++) {
+		size_t from = history * size_t(c) / size_t(columns);
+		size_t to = std::max(from + 1, history * size_t(c + 1) / size_t(columns));
+		float lo = 1.0f, hi = -1.0f;
+		for (size_t i = from; i < to; i++) {
+			float v = w.__history[(w.__write + i) % history];
+			lo = std::min(lo, v);
+			hi = std::max(hi, v);
+		}
+
+		lo = std::clamp(lo, -1.0f, 1.0f);
+		hi = std::clamp(hi, -1.0f, 1.0f);
+		w.__spans[c * 2] = int16_t(half - hi * half);
+		w.__spans[c * 2 + 1] = int16_t(half - lo * half);
+	}
+
+	dev.drawColumns(tb.x, tb.y, w.__spans.data(), columns, w.color.r, w.color.g, w.color.b);
+}
+
+UI_WIDGET_BOUNDS_IMPL(Scope) {
+	Rect b = Rect(ctx.bounds.x, ctx.bounds.y, w.width, w.height);
+	if (w.width <= 0) b.width = ctx.bounds.width;
+	if (w.height <= 0) b.height = ctx.bounds.height;
+	return b;
+}
+
+UI_WIDGET_DRAW_IMPL(Image) {
+	Rect pb = sys->bounds(wid);
+	dev.drawImage(dev.image(w.source), pb.x, pb.y, pb.width, pb.height, w.tint.r, w.tint.g, w.tint.b);
+}
+
+UI_WIDGET_BOUNDS_IMPL(Image) {
+	auto [iw, ih] = dev.imageSize(dev.image(w.source));
+	return Rect(ctx.bounds.x, ctx.bounds.y, w.width > 0 ? w.width : iw, w.height > 0 ? w.height : ih);
+}
+
+constexpr double PlotZoomStep = 1.25; // per wheel notch
+constexpr double PlotMinSpan = 8.0; // samples
+
+// Keeps the visible samples inside the data, showing all of it when they're unset or stale
+static void plotView(Plot& w, double begin, double end) {
+	const double size = w.data ? double(w.data->size()) : 0.0;
+	const double span = std::clamp(end - begin, std::min(PlotMinSpan, size), size);
+	w.__begin = std::clamp(begin, 0.0, size - span);
+	w.__end = w.__begin + span;
+}
+
+static void plotView(Plot& w) {
+	const double size = w.data ? double(w.data->size()) : 0.0;
+	if (w.__end <= w.__begin || w.__end > size) plotView(w, 0.0, size);
+}
+
+UI_WIDGET_DRAW_IMPL(Plot) {
+	Rect pb = sys->bounds(wid);
+	dev.drawPatch(4, pb.x, pb.y, pb.width, pb.height);
+
+	Rect tb(pb);
+	tb.pad(GlobalPadding, GlobalPadding, GlobalPadding, GlobalPadding);
+	if (!tb.valid() || !w.data || w.data->size() == 0) return;
+
+	const PlotData& data = *w.data;
+	plotView(w);
+
+	float lo = w.min, hi = w.max;
+	if (lo == 0.0f && hi == 0.0f) {
+		auto all = data.range();
+		lo = all.lo;
+		hi = all.hi;
+	}
+	if (w.fill) {
+		lo = std::min(lo, 0.0f);
+		hi = std::max(hi, 0.0f);
+	}
+	if (hi <= lo) hi = lo + 1.0f;
+
+	const float scale = float(tb.height - 1) / (hi - lo);
+	auto toY = [&](float v) { return int16_t(std::clamp((hi - v) * scale, 0.0f, float(tb.height - 1)) + 0.5f); };
+	const int16_t zero = toY(0.0f);
+
+	// One min/max per column from the pyramid; each column reaches the next one's first
+	// sample so the line stays connected when zoomed in
+	const int columns = tb.width;
+	const double perColumn = (w.__end - w.__begin) / double(columns);
+	w.__spans.resize(size_t(columns) * 2);
+
+	for (int c = 0; c < columns; c++) {
+		const double from = w.__begin + perColumn * c;
+		PlotData::Range r;
+		if (perColumn >= 1.0) {
+			r = data.range(size_t(from), size_t(from + perColumn) + 1);
+		} else {
+			float a = data.at(from), b = data.at(from + perColumn);
+			r = PlotData::Range{ std::min(a, b), std::max(a, b) };
+		}
+
+		int16_t top = toY(r.hi), bottom = toY(r.lo);
+		if (w.fill) {
+			top = std::min(top, zero);
+			bottom = std::max(bottom, zero);
+		}
+		w.__spans[c * 2] = top;
+		w.__spans[c * 2 + 1] = bottom;
+	}
+
+	dev.drawColumns(tb.x, tb.y, w.__spans.data(), columns, w.color.r, w.color.g, w.color.b);
+}
+
+UI_WIDGET_BOUNDS_IMPL(Plot) {
+	Rect b = Rect(ctx.bounds.x, ctx.bounds.y, w.width, w.height);
+	if (w.width <= 0) b.width = ctx.bounds.width;
+	if (w.height <= 0) b.height = ctx.bounds.height;
+	return b;
+}
+
+UI_WIDGET_MOUSE_EVENT_IMPL(Plot) {
+	Rect tb = sys->bounds(wid);
+	tb.pad(GlobalPadding, GlobalPadding, GlobalPadding, GlobalPadding);
+	if (!tb.valid() || !w.data) return false;
+
+	plotView(w);
+	const double begin = w.__begin, end = w.__end;
+	const double perPixel = (end - begin) / double(tb.width);
+
+	// Dragging pans, the wheel zooms around the cursor
+	if (e.type == MouseEvent::MouseEventDown) {
+		if (!tb.has(e.x, e.y)) return false;
+		w.__dragging = true;
+		w.__dragX = e.x;
+		return true;
+	} else if (e.type == MouseEvent::MouseEventUp) {
+		if (!w.__dragging) return false;
+		w.__dragging = false;
+		return true;
+	} else if (e.type == MouseEvent::MouseEventMove) {
+		if (!w.__dragging) return false;
+		const double shift = double(w.__dragX - e.x) * perPixel;
+		w.__dragX = e.x;
+		plotView(w, begin + shift, end + shift);
+	} else if (e.type == MouseEvent::MouseEventWheel) {
+		if (!tb.has(e.x, e.y) || e.wheelY == 0) return false;
+		const double at = begin + double(e.x - tb.x) * perPixel;
+		const double factor = std::pow(PlotZoomStep, -e.wheelY);
+		plotView(w, at - (at - begin) * factor, at + (end - at) * factor);
+	}
+
+	if (w.__begin == begin && w.__end == end) return false;
+	sys->markDirty(wid);
+	return true;
+}
+
+// --------------- DISPATCH
+// Defined after every widget specialization above
+
+inline void UISystem::draw(Device& dev, WID id, const Context& ctx) {
+	// The root is always created last
+	const bool root = !m_widgets.empty() && id == m_widgets.rbegin()->first;
+	if (root) {
+		drainUpdates();
+		m_time = m_clock();
+		m_wake = Idle;
+		discardDestroyed(dev);
+		resumeTasks();
+		if (m_trace) m_trace->frame(m_time);
+		if (focused != m_drawnFocus) {
+			if (m_drawnFocus) markDirty(m_drawnFocus);
+			if (focused) markDirty(focused);
+			m_drawnFocus = focused;
+		}
+		stepAnimations();
+		propagate();
+
+		auto size = dev.size();
+		if (m_layoutDirty || size != m_layoutSize || dev.generation() != m_layoutGeneration) {
+			UI_PROFILE_SCOPE("layout");
+			uint64_t t0 = dev.statsBegin();
+			bounds(dev, id, ctx);
+			dev.statsEnd(FrameStats::PhaseLayout, t0);
+
+			m_layoutDirty = false;
+			m_layoutSize = size;
+			m_layoutGeneration = dev.generation();
+		}
+	}
+
+	// Skip widgets scrolled out of the enclosing viewport
+	if (!m_viewports.empty() && !m_widgetBounds[id].overlaps(m_viewports.back())) return;
+
+	uint64_t t0 = root ? dev.statsBegin() : 0;
+	auto& wid = m_widgets[id];
+	std::visit([&](auto&& w) {
+		using W = std::decay_t<decltype(w)>;
+		UI_PROFILE_SCOPE_ID(WidgetInfo<W>::name.data(), id);
+		if constexpr (internal::cachedOf<W>()) {
+			// The focused widget may animate (the input cursor blinks), so it's always recorded
+			uint32_t version = id < m_versions.size() ? m_versions[id] : 0;
+			if (id == focused) internal::draw(dev, id, w, ctx, this);
+			else if (!dev.replay(id, ctx.bounds, version)) {
+				dev.beginCapture(id, ctx.bounds, version);
+				internal::draw(dev, id, w, ctx, this);
+				dev.endCapture();
+			}
+		} else {
+			internal::draw(dev, id, w, ctx, this);
+		}
+	}, wid);
+	if (root) {
+		dev.statsEnd(FrameStats::PhaseRecord, t0);
+		commitParameters();
+		clearDirty();
+	}
+}
+
+inline void UISystem::bounds(Device& dev, WID id, const Context& ctx) {
+	if (dev.statsEnabled()) dev.stats().widgetsVisited++;
+	auto& wid = m_widgets[id];
+	m_widgetBounds[id] = std::visit([&](auto&& w) {
+		UI_PROFILE_SCOPE_ID(WidgetInfo<std::decay_t<decltype(w)>>::name.data(), id);
+		return internal::bounds(dev, id, w, ctx, this);
+	}, wid);
+}
+
+inline bool UISystem::processMouse(Device& dev, const MouseEvent& e, WID id, const Context& ctx) {
+	if (!m_viewports.empty() && !m_widgetBounds[id].overlaps(m_viewports.back())) return false;
+	auto& wid = m_widgets[id];
+	bool handled = std::visit([&](auto&& w) { return internal::onMouseEvent(dev, e, id, w, ctx, this); }, wid);
+
+	// The innermost handler returns first
+	if (handled && e.type == MouseEvent::MouseEventDown && !m_captured) m_captured = id;
+	return handled;
+}
+
+inline bool UISystem::processCaptured(Device& dev, const MouseEvent& e) {
+	auto it = m_widgets.find(m_captured);
+	if (it == m_widgets.end()) {
+		m_captured = 0;
+		return false;
+	}
+	const Context ctx{ .bounds = bounds(m_captured) };
+	return std::visit([&](auto&& w) { return internal::onMouseEvent(dev, e, m_captured, w, ctx, this); }, it->second);
+}
+
+inline void UISystem::processKeyboard(Device& dev, const KeyboardEvent& e, WID id) {
+	if (id == 0) return;
+	auto& wid = m_widgets[id];
+	std::visit([&](auto&& w) { internal::onKeyEvent(dev, e, id, w, this); }, wid);
+}
+
+// --------------- IMMEDIATE MODE
+
+/**
+ * Immediate-mode front end. Widgets are declared every frame between begin() and end()
+ * and drawn straight into the Device, laid out top to bottom by a cursor. Their state
+ * (hover, focus, cursor) is kept per hashed id in a private UISystem, whose Button,
+ * Slider, Input and Text code handles drawing and events.
+ */
+class ImmediateUI {
+public:
+	static constexpr int Spacing = 4;
+
+	explicit ImmediateUI(Device& dev) : m_dev(dev) {
+		m_idStack.reserve(16);
+	}
+
+	ImmediateUI(const ImmediateUI&) = delete;
+	ImmediateUI& operator=(const ImmediateUI&) = delete;
+
+	/**
+	 * @brief  Queues an input event for the widgets declared in the next frame
+	 * @retval None
+	 */
+	void processEvents(const SDL_Event& e) {
+		const bool ctrl = SDL_GetModState() & KMOD_CTRL;
+		switch (e.type) {
+			default: return;
+			case SDL_MOUSEBUTTONDOWN:
+			case SDL_MOUSEBUTTONUP:
+				m_mouse.push_back(QueuedMouse{ MouseEvent{
+					.type = e.type == SDL_MOUSEBUTTONDOWN ? MouseEvent::MouseEventDown : MouseEvent::MouseEventUp,
+					.x = e.button.x, .y = e.button.y, .button = e.button.button
+				} });
+				break;
+			case SDL_MOUSEMOTION:
+				m_mouse.push_back(QueuedMouse{ MouseEvent{
+					.type = MouseEvent::MouseEventMove, .x = e.motion.x, .y = e.motion.y
+				} });
+				break;
+			case SDL_KEYDOWN:
+				m_keys.push_back(KeyboardEvent{
+					.type = ctrl ? KeyboardEvent::KeyEventCommand : KeyboardEvent::KeyEventDown,
+					.key = uint32_t(e.key.keysym.sym)
+				});
+				break;
+			case SDL_TEXTINPUT:
+				if (ctrl) return;
+				for (const char* c = e.text.text; *c; c++) {
+					m_keys.push_back(KeyboardEvent{ .type = KeyboardEvent::KeyEventType, .input = *c });
+				}
+				break;
+		}
+		m_dev.inputConsumed(e.common.timestamp);
+	}
+
+	/**
+	 * @brief  Starts a frame
+	 * @param  area: Rectangle widgets are laid out in
+	 * @retval None
+	 */
+	void begin(const Rect& area) {
+		m_sys.m_time = m_sys.m_clock();
+		m_sys.m_wake = UISystem::Idle;
+		m_area = area;
+		m_cursorY = area.y;
+		m_last = Rect(area.x, area.y, 0, 0);
+		m_sameLine = false;
+		m_activated = 0;
+		m_idStack.assign(1, FNVOffset);
+	}
+
+	/**
+	 * @brief  Ends a frame, dropping the state of widgets that weren't declared in it
+	 * @retval None
+	 */
+	void end() {
+		m_mouse.clear();
+		m_keys.clear();
+		m_sys.clearDirty();
+
+		if (m_entries.size() > m_declared) {
+			for (auto it = m_entries.begin(); it != m_entries.end();) {
+				if (it->second.frame == m_frame) {
+					++it;
+					continue;
+				}
+				m_sys.forget(it->second.wid);
+				m_sys.m_widgets.erase(it->second.wid);
+				m_freeIDs.push_back(it->second.wid);
+				it = m_entries.erase(it);
+			}
+			m_sys.discardDestroyed(m_dev);
+		}
+		m_declared = 0;
+		m_frame++;
+	}
+
+	// Scopes ids, e.g. per row of a generated list
+	void pushID(std::string_view id) { m_idStack.push_back(hash(m_idStack.back(), id.data(), id.size())); }
+	void pushID(int index) { m_idStack.push_back(hash(m_idStack.back(), &index, sizeof(index))); }
+	void popID() { if (m_idStack.size() > 1) m_idStack.pop_back(); }
+
+	// Places the next widget to the right of the previous one
+	void sameLine() { m_sameLine = true; }
+
+	// Width of the following widgets; 0 fills the rest of the line
+	void itemWidth(int width) { m_itemWidth = width; }
+
+	void text(std::string_view str, Color color = Color{ 255, 255, 255 }, Alignment align = Alignment::Near) {
+		m_text.text.assign(str);
+		m_text.color = color;
+		m_text.align = align;
+
+		const int width = m_itemWidth > 0 || align != Alignment::Near ? 0 : m_dev.textWidth(str);
+		Rect b = place(width, m_dev.cellHeight());
+		internal::draw(m_dev, 0, m_text, Context{ .bounds = b }, &m_sys);
+	}
+
+	/**
+	 * @retval true in the frame the button is clicked
+	 */
+	bool button(std::string_view id, std::string_view label, bool disabled = false) {
+		auto [wid, w] = widget<Button>(id);
+		if (!w.onPressed) w.onPressed = [this, wid = wid]() { m_activated = wid; };
+		w.text.assign(label);
+		w.disabled = disabled;
+
+		Rect b = place(0, lineHeight());
+		dispatch(wid, w, b);
+		internal::draw(m_dev, wid, w, Context{ .bounds = b }, &m_sys);
+		return m_activated == wid;
+	}
+
+	/**
+	 * @param  step: Value increment, 0 for continuous
+	 * @retval true if the value was changed by input
+	 */
+	bool slider(std::string_view id, float& value, float min, float max, float step = 0.0f) {
+		auto [wid, w] = widget<Slider>(id);
+		w.min = min;
+		w.max = max;
+		w.step = step;
+		w.value = value;
+
+		Rect b = place(0, SliderHeight);
+		dispatch(wid, w, b);
+		internal::draw(m_dev, wid, w, Context{ .bounds = b }, &m_sys);
+
+		const bool changed = w.value != value;
+		value = w.value;
+		return changed;
+	}
+
+	/**
+	 * @retval true if the text was edited
+	 */
+	bool input(std::string_view id, std::string& text, bool masked = false) {
+		auto [wid, w] = widget<Input>(id);
+		if (w.text != text) {
+			w.text = text;
+			w.__cursor = std::min(w.__cursor, int(text.size()));
+		}
+		w.masked = masked;
+
+		Rect b = place(0, lineHeight());
+		dispatch(wid, w, b);
+		if (m_sys.focused == wid) {
+			for (const KeyboardEvent& e : m_keys) internal::onKeyEvent(m_dev, e, wid, w, &m_sys);
+		}
+		internal::draw(m_dev, wid, w, Context{ .bounds = b }, &m_sys);
+
+		if (w.text == text) return false;
+		text = w.text;
+		return true;
+	}
+
+	/**
+	 * @brief  Time until the next frame is needed, as UISystem::timeout
+	 */
+	int timeout() const { return m_sys.timeout(); }
+
+private:
+	static constexpr uint64_t FNVOffset = 14695981039346656037ull;
+
+	struct QueuedMouse {
+		MouseEvent event;
+		bool handled{ false };
+	};
+
+	struct Entry {
+		WID wid;
+		Widget* widget; // std::map nodes don't move
+		uint32_t frame;
+	};
+
+	Device& m_dev;
+	UISystem m_sys;
+	Text m_text;
+
+	std::unordered_map<uint64_t, Entry> m_entries;
+	std::vector<WID> m_freeIDs; // of dropped widgets, whose display lists are already gone
+	std::vector<uint64_t> m_idStack;
+	std::vector<QueuedMouse> m_mouse;
+	std::vector<KeyboardEvent> m_keys;
+	uint32_t m_frame{ 0 };
+	size_t m_declared{ 0 };
+	WID m_activated{ 0 };
+
+	Rect m_area, m_last;
+	int m_cursorY{ 0 }, m_itemWidth{ 0 };
+	bool m_sameLine{ false };
+
+	int lineHeight() const { return m_dev.cellHeight() + GlobalPadding * 2; }
+
+	static uint64_t hash(uint64_t seed, const void* data, size_t size) {
+		auto bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) seed = (seed ^ bytes[i]) * 1099511628211ull;
+		return seed;
+	}
+
+	template<typename W>
+	std::pair<WID, W&> widget(std::string_view id) {
+		const uint64_t key = hash(m_idStack.back(), id.data(), id.size());
+		auto it = m_entries.find(key);
+		if (it == m_entries.end()) {
+			// Reusing ids keeps the system's per-id tables as large as the busiest frame
+			WID wid;
+			if (m_freeIDs.empty()) wid = m_sys.create(W{});
+			else {
+				wid = m_freeIDs.back();
+				m_freeIDs.pop_back();
+				m_sys.m_widgets[wid] = W{};
+			}
+			it = m_entries.emplace(key, Entry{ .wid = wid, .widget = &m_sys.m_widgets[wid], .frame = m_frame - 1 }).first;
+		}
+
+		Entry& entry = it->second;
+		if (entry.frame != m_frame) m_declared++;
+		entry.frame = m_frame;
+
+		// The same id reused for another kind of widget starts over
+		if (!std::holds_alternative<W>(*entry.widget)) *entry.widget = W{};
+		return { entry.wid, std::get<W>(*entry.widget) };
+	}
+
+	Rect place(int width, int height) {
+		int x = m_area.x, y = m_cursorY;
+		if (m_sameLine) {
+			x = m_last.x + m_last.width + Spacing;
+			y = m_last.y;
+		}
+		if (m_itemWidth > 0) width = m_itemWidth;
+		else if (width <= 0) width = m_area.x + m_area.width - x;
+
+		Rect r(x, y, width, height);
+		m_cursorY = std::max(m_cursorY, y + height + Spacing);
+		m_last = r;
+		m_sameLine = false;
+		return r;
+	}
+
+	// Mouse events stop at the first widget handling them, in declaration order
+	template<typename W>
+	void dispatch(WID wid, W& w, const Rect& bounds) {
+		m_sys.m_widgetBounds[wid] = bounds;
+		for (QueuedMouse& q : m_mouse) {
+			if (q.handled) continue;
+			q.handled = internal::onMouseEvent(m_dev, q.event, wid, w, Context{ .bounds = bounds }, &m_sys);
+		}
+	}
+};
+
 #endif // UI_H
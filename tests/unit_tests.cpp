@@ -0,0 +1,225 @@
+// Unit checks for the building blocks of ui.h that the demo can't exercise reliably:
+// the SPSC ring, the plot pyramid, LEB128 varints, name tables, binding order and the
+// atlas packer. Prints every failed check and exits non-zero if there was one.
+//
+// usage: unit_tests <skin>
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "sdl.h"
+#include "ui.h"
+
+static int g_failures = 0;
+
+static void check(bool ok, const char* what, const char* file, int line) {
+	if (ok) return;
+	std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+	g_failures++;
+}
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void testSpscRing() {
+	SpscRing<int> ring(5);
+	CHECK(ring.capacity() == 8);
+
+	for (int i = 0; i < 8; i++) CHECK(ring.push(i));
+	CHECK(!ring.push(8));
+	CHECK(ring.size() == 8);
+
+	int v = -1;
+	CHECK(ring.pop(v) && v == 0);
+
+	// Bulk operations stop at what fits or what's there, and wrap around the buffer
+	int in[4] = { 10, 11, 12, 13 }, out[16] = {};
+	CHECK(ring.push(in, 4) == 1);
+	CHECK(ring.pop(out, 16) == 8);
+	CHECK(out[0] == 1 && out[6] == 7 && out[7] == 10);
+	CHECK(!ring.pop(v));
+	CHECK(ring.push(in, 4) == 4);
+	CHECK(ring.pop(out, 2) == 2 && out[0] == 10 && out[1] == 11);
+
+	// Everything arrives once and in order across threads
+	SpscRing<uint32_t> shared(64);
+	constexpr uint32_t Count = 200000;
+	std::thread producer([&]() {
+		for (uint32_t i = 0; i < Count;) {
+			if (shared.push(i)) i++;
+		}
+	});
+	uint32_t expected = 0, got;
+	bool ordered = true;
+	while (expected < Count) {
+		if (!shared.pop(got)) continue;
+		ordered = ordered && got == expected;
+		expected++;
+	}
+	producer.join();
+	CHECK(ordered);
+	CHECK(shared.size() == 0);
+}
+
+static void testPlotRange() {
+	CHECK(PlotData().range(0, 10).lo == 0.0f);
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	for (size_t n : { 1, 2, 3, 7, 8, 9, 100, 1023, 4097 }) {
+		std::vector<float> samples(n);
+		for (float& s : samples) s = dist(rng);
+		PlotData data(samples);
+
+		const size_t step = n > 200 ? 17 : 1;
+		bool exact = true;
+		for (size_t from = 0; from < n; from += step) {
+			for (size_t to = from + 1; to <= n + 1; to += step) {
+				float lo = samples[from], hi = samples[from];
+				for (size_t i = from; i < std::min(to, n); i++) {
+					lo = std::min(lo, samples[i]);
+					hi = std::max(hi, samples[i]);
+				}
+				PlotData::Range r = data.range(from, to);
+				exact = exact && r.lo == lo && r.hi == hi;
+			}
+		}
+		CHECK(exact);
+	}
+}
+
+static void testVarints() {
+	const uint64_t values[] = { 0, 1, 127, 128, 300, 16383, 16384, uint64_t(1) << 32, std::numeric_limits<uint64_t>::max() };
+	std::vector<uint8_t> data;
+	for (uint64_t v : values) internal::writeVarint(data, v);
+	size_t pos = 0;
+	for (uint64_t v : values) CHECK(internal::readVarint(data, pos) == v);
+	CHECK(pos == data.size());
+
+	// Seven bits per byte
+	auto length = [](uint64_t v) {
+		std::vector<uint8_t> out;
+		internal::writeVarint(out, v);
+		return out.size();
+	};
+	CHECK(length(127) == 1);
+	CHECK(length(128) == 2);
+	CHECK(length(std::numeric_limits<uint64_t>::max()) == 10);
+
+	const int64_t signedValues[] = { 0, -1, 1, -64, 64, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max() };
+	data.clear();
+	for (int64_t v : signedValues) internal::writeZigzag(data, v);
+	pos = 0;
+	for (int64_t v : signedValues) CHECK(internal::readZigzag(data, pos) == v);
+
+	// A truncated varint stops at the end instead of reading past it
+	data = { 0x80, 0x80 };
+	pos = 0;
+	internal::readVarint(data, pos);
+	CHECK(pos == 2);
+}
+
+static void testNameTable() {
+	static constexpr std::array<std::string_view, 5> Names = { "width", "height", "text", "value", "child" };
+	static constexpr NameTable<5> table{ Names };
+	static_assert(table.find("text") == 2);
+
+	for (size_t i = 0; i < Names.size(); i++) CHECK(table.find(Names[i]) == int(i));
+	CHECK(table.find("") == -1);
+	CHECK(table.find("textt") == -1);
+	CHECK(table.find("Width") == -1);
+
+	// The registry's own tables
+	CHECK(internal::classTable.find("Button") >= 0);
+	CHECK(internal::classTable.find("Nope") == -1);
+	CHECK(internal::propertyTable<Slider>.find("value") >= 0);
+}
+
+static void testBindingOrder(Device& dev) {
+	// Bound in reverse, so only a dependency-ordered pass reaches the end in one frame
+	UISystem sys;
+	WID a = sys.create(Slider{}), b = sys.create(Slider{}), c = sys.create(Slider{}), d = sys.create(Slider{});
+	WID root = sys.create(Root{ .child = sys.create(Column{ .children = { a, b, c, d } }) });
+	CHECK(sys.bind(c, "value", d, "value"));
+	CHECK(sys.bind(b, "value", c, "value"));
+	CHECK(sys.bind(a, "value", b, "value"));
+	CHECK(!sys.bind(a, "value", d, "nope"));
+
+	sys.set(a, "value", 42.0f);
+	sys.draw(dev, root, Context());
+	dev.flush();
+	CHECK(sys.get<Slider>(d)->value == 42.0f);
+
+	// A cycle doesn't stop the rest from propagating
+	CHECK(sys.bind(d, "value", a, "value"));
+	sys.set(b, "value", 7.0f);
+	sys.draw(dev, root, Context());
+	dev.flush();
+	CHECK(sys.get<Slider>(d)->value == 7.0f);
+}
+
+static void testAtlasPacker() {
+	AtlasPacker packer(64, 64);
+	CHECK(!packer.add(65, 1));
+	CHECK(!packer.add(0, 4));
+
+	// Fill the page with 16x16 tiles; none overlap and all stay inside
+	std::vector<Rect> placed;
+	while (auto r = packer.add(16, 16)) placed.push_back(*r);
+	CHECK(placed.size() == 16);
+	bool inside = true, disjoint = true;
+	for (size_t i = 0; i < placed.size(); i++) {
+		const Rect& r = placed[i];
+		inside = inside && r.x >= 0 && r.y >= 0 && r.x + r.width <= 64 && r.y + r.height <= 64;
+		for (size_t j = i + 1; j < placed.size(); j++) disjoint = disjoint && !r.overlaps(placed[j]);
+	}
+	CHECK(inside);
+	CHECK(disjoint);
+	CHECK(!packer.add(1, 1));
+
+	// Freed space is reused, and a freed bottom row takes other heights again
+	packer.remove(placed[5]);
+	auto again = packer.add(16, 16);
+	CHECK(again && again->x == placed[5].x && again->y == placed[5].y);
+	for (size_t i = 12; i < 16; i++) packer.remove(placed[i]);
+	CHECK(packer.add(64, 10).has_value());
+	CHECK(!packer.add(64, 10).has_value());
+}
+
+int main(int argc, const char** argv) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <skin>\n", argv[0]);
+		return 1;
+	}
+
+	testSpscRing();
+	testPlotRange();
+	testVarints();
+	testNameTable();
+	testAtlasPacker();
+
+	// Bindings propagate while drawing, which needs a renderer
+	SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* win = SDL_CreateWindow("Unit tests", 0, 0, 320, 240, SDL_WINDOW_HIDDEN);
+	SDL_Renderer* ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_SOFTWARE);
+	{
+		Device dev(win, ren);
+		CHECK(dev.loadSkin(argv[1]));
+		if (dev.skin()) testBindingOrder(dev);
+	}
+	SDL_DestroyRenderer(ren);
+	SDL_DestroyWindow(win);
+	SDL_Quit();
+
+	if (g_failures) {
+		std::fprintf(stderr, "%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	std::printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,148 @@
+// Headless replay of input traces recorded with the demo's --record option.
+// Feeds the events back frame by frame and reports how long each frame took.
+// Built with UI_ALLOC_CHECK, it fails when a frame without input allocates.
+//
+// usage: replay <trace> [--ui file] [--skin file] [--size WxH] [--realtime]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sdl.h"
+#include "ui.h"
+#include "alloc_check.h"
+
+// Time of the frame being replayed, so animations match the recording
+static double g_traceTime = 0.0;
+static double traceClock() { return g_traceTime; }
+
+static double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	size_t i = std::min(sorted.size() - 1, size_t(p * double(sorted.size() - 1) + 0.5));
+	return sorted[i];
+}
+
+int main(int argc, const char** argv) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <trace> [--ui file] [--skin file] [--size WxH] [--realtime]\n", argv[0]);
+		return 1;
+	}
+
+	std::string ui = "../test.ui", skin = "../gui.bmp";
+	int width = 800, height = 600;
+	bool realtime = false;
+	for (int i = 2; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--ui") && i + 1 < argc) ui = argv[++i];
+		else if (!std::strcmp(argv[i], "--skin") && i + 1 < argc) skin = argv[++i];
+		else if (!std::strcmp(argv[i], "--size") && i + 1 < argc) std::sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (!std::strcmp(argv[i], "--realtime")) realtime = true;
+	}
+
+	if (!AllocCheck::install()) {
+		std::fprintf(stderr, "Can't hook SDL's allocator: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	InputTrace trace;
+	if (!trace.load(argv[1])) {
+		std::fprintf(stderr, "Can't read trace %s\n", argv[1]);
+		return 1;
+	}
+
+	// No window system needed
+	SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+	SDL_Init(SDL_INIT_VIDEO);
+
+	SDL_Window* win = SDL_CreateWindow("Replay", 0, 0, width, height, SDL_WINDOW_HIDDEN);
+	SDL_Renderer* ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_SOFTWARE);
+
+	std::unique_ptr<Device> dev = std::make_unique<Device>(win, ren);
+	if (!dev->loadSkin(skin)) {
+		std::fprintf(stderr, "%s\n", dev->skinError().c_str());
+		return 1;
+	}
+
+	std::unique_ptr<UISystem> sys = std::make_unique<UISystem>();
+	sys->setClock(traceClock);
+	WID body = sys->loadUI(ui);
+	if (!body) {
+		std::fprintf(stderr, "Can't load UI %s\n", ui.c_str());
+		return 1;
+	}
+
+	const double frequency = double(SDL_GetPerformanceFrequency());
+	const uint64_t start = SDL_GetPerformanceCounter();
+
+	std::vector<double> frameTimes;
+	size_t events = 0;
+	uint64_t frameStart = 0;
+	bool inFrame = false;
+
+	// Frames without input since the last event; the first ones may still warm up caches
+	int quietFrames = 0;
+	size_t allocations = 0;
+
+	// Each frame mark draws the events read since the previous one
+	auto drawFrame = [&]() {
+		const bool steady = quietFrames++ > 2;
+		if (steady) AllocCheck::arm();
+		sys->draw(*dev, body, Context());
+		dev->flush();
+		dev->present();
+		if (steady) allocations += AllocCheck::disarm();
+		frameTimes.push_back(double(SDL_GetPerformanceCounter() - frameStart) / frequency * 1000.0);
+	};
+
+	SDL_Event e;
+	double time;
+	while (auto tag = trace.next(e, time)) {
+		if (!inFrame) {
+			if (realtime) {
+				double now = double(SDL_GetPerformanceCounter() - start) / frequency;
+				if (time > now) SDL_Delay(Uint32((time - now) * 1000.0));
+			}
+			frameStart = SDL_GetPerformanceCounter();
+			inFrame = true;
+		}
+
+		if (*tag == InputTrace::TagFrame) {
+			g_traceTime = time;
+			drawFrame();
+			inFrame = false;
+		} else {
+			sys->processEvents(*dev, e, body);
+			events++;
+			quietFrames = 0;
+		}
+	}
+
+	const double total = double(SDL_GetPerformanceCounter() - start) / frequency * 1000.0;
+
+	std::vector<double> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (double t : sorted) sum += t;
+
+	std::printf("events %zu frames %zu total %.2f ms\n", events, sorted.size(), total);
+	if (!sorted.empty()) {
+		std::printf("frame ms: mean %.3f p50 %.3f p99 %.3f max %.3f\n",
+			sum / double(sorted.size()), percentile(sorted, 0.5), percentile(sorted, 0.99), sorted.back());
+	}
+
+	sys.reset();
+	dev.reset();
+	SDL_DestroyRenderer(ren);
+	SDL_DestroyWindow(win);
+	SDL_Quit();
+
+#ifdef UI_ALLOC_CHECK
+	if (allocations) {
+		std::fprintf(stderr, "Frames without input performed %zu heap allocation(s)\n", allocations);
+		return 1;
+	}
+#endif
+	return 0;
+}